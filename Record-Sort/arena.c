@@ -0,0 +1,104 @@
+/*
+ * Bump allocator for record names
+ *
+ * Names are packed back-to-back into large chunks, so loading costs one
+ * malloc per chunk instead of one per record, and the whole lot is
+ * returned with one free per chunk.
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.
+ * If not, see <https://www.gnu.org/licenses/>
+ */
+
+#include <stdlib.h>
+#include <string.h>
+
+#include "record_sort.h"
+
+struct arena_chunk {
+	struct arena_chunk *next;
+	size_t size;
+	size_t used;
+	char data[];
+};
+
+void *arena_alloc (arena_t *arena, size_t len)
+/*
+ * Hand out len bytes with no alignment guarantee.  Requests that would
+ * waste most of a chunk get a chunk of their own, which is linked
+ * behind the current one so the current chunk keeps filling.
+ */
+{
+	arena_chunk_t *chunk = arena->head;
+	size_t size;
+
+	if (chunk == NULL || chunk->size - chunk->used < len)
+	{
+		size = len > ARENA_CHUNK/4 ? len : ARENA_CHUNK;
+		if ((chunk = malloc (sizeof (arena_chunk_t) + size)) == NULL)
+			return NULL;
+		chunk->size = size;
+		chunk->used = 0;
+		if (size != ARENA_CHUNK && arena->head != NULL)
+		{
+			chunk->next = arena->head->next;
+			arena->head->next = chunk;
+		}
+		else
+		{
+			chunk->next = arena->head;
+			arena->head = chunk;
+		}
+		arena->chunks++;
+		arena->reserved += size;
+	}
+
+	chunk->used += len;
+	arena->used += len;
+	if (arena->used > arena->peak)
+		arena->peak = arena->used;
+	return chunk->data + chunk->used - len;
+}
+
+char *arena_strndup (arena_t *arena, const char *s, size_t len)
+/*
+ * Copy len bytes of s into the arena and terminate them
+ */
+{
+	char *p;
+
+	if ((p = arena_alloc (arena, len + 1)) == NULL)
+		return NULL;
+	memcpy (p, s, len);
+	p[len] = '\0';
+	return p;
+}
+
+void arena_release (arena_t *arena)
+/*
+ * Return every chunk.  The peak survives so it can be reported after
+ * the records are gone.
+ */
+{
+	arena_chunk_t *chunk, *next;
+
+	for (chunk = arena->head; chunk != NULL; chunk = next)
+	{
+		next = chunk->next;
+		free (chunk);
+	}
+	arena->head = NULL;
+	arena->chunks = 0;
+	arena->used = 0;
+	arena->reserved = 0;
+}
@@ -0,0 +1,126 @@
+/*
+ * Collation keys for the record_sort example
+ *
+ * Sorting with strcasecmp() or strcoll() would put the collation rules
+ * inside every comparison.  Instead each name is transformed once into
+ * a sort key, a string whose plain strcmp() order is the collation
+ * order: the name folded to lower case for COLLATE_NOCASE, or the
+ * strxfrm() of the name in the LC_COLLATE locale for COLLATE_LOCALE.
+ * The keys are swapped into the records in place of the names, so every
+ * sort, radix included, runs unchanged on bytes, and the names are put
+ * back afterwards.
+ *
+ * Each key is stored in its own arena with the record's name pointer
+ * just in front of it, so the name travels with the key however the
+ * records are moved.
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.
+ * If not, see <https://www.gnu.org/licenses/>
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <locale.h>
+
+#include "record_sort.h"
+
+static arena_t key_arena;
+
+int parse_collation (const char *arg)
+/*
+ * COLLATE_ mode for a --collate argument, or -1 if it isn't known
+ */
+{
+	if (strcmp (arg, "bytes") == 0)
+		return COLLATE_BYTES;
+	if (strcmp (arg, "nocase") == 0)
+		return COLLATE_NOCASE;
+	if (strcmp (arg, "locale") == 0)
+		return COLLATE_LOCALE;
+	return -1;
+}
+
+static char *make_key (char *name, int mode)
+/*
+ * The name pointer followed by the sort key for name, in the key arena.
+ * Returns the key, or NULL if memory ran out.
+ */
+{
+	size_t len = strlen (name), need, i;
+	char *block, *key;
+
+	if (mode == COLLATE_NOCASE)
+		need = len;
+	else
+		need = strxfrm (NULL, name, 0);
+	if ((block = arena_alloc (&key_arena, sizeof (char *) + need + 1)) == NULL)
+		return NULL;
+	memcpy (block, &name, sizeof (char *));
+	key = block + sizeof (char *);
+
+	if (mode == COLLATE_NOCASE)
+	{
+		// ASCII only, so the key doesn't depend on the locale
+		for (i = 0; i < len; i++)
+			key[i] = name[i] >= 'A' && name[i] <= 'Z' ? name[i] - 'A' + 'a' : name[i];
+		key[len] = '\0';
+	}
+	else
+		strxfrm (key, name, need + 1);
+	return key;
+}
+
+int collate_names (int size, record_t records[], int mode, int verbose)
+/*
+ * Replace each name by its sort key for mode.  Returns 0, or -1 if
+ * memory ran out, when the names are left as they were.
+ */
+{
+	double start = now_ms ();
+	char *key;
+	int i;
+
+	if (mode == COLLATE_BYTES)
+		return 0;
+	if (mode == COLLATE_LOCALE)
+		setlocale (LC_COLLATE, "");
+	for (i = 0; i < size; i++)
+	{
+		if ((key = make_key (records[i].name, mode)) == NULL)
+		{
+			restore_names (i, records);
+			return -1;
+		}
+		records[i].name = key;
+	}
+	if (verbose)
+		fprintf (stderr, "%d collation keys (%zu bytes) built in %.3f ms\n",
+			size, key_arena.used, now_ms () - start);
+	return 0;
+}
+
+void restore_names (int size, record_t records[])
+/*
+ * Put back the names replaced by collate_names() and free the keys
+ */
+{
+	int i;
+
+	if (key_arena.head == NULL)
+		return;
+	for (i = 0; i < size; i++)
+		memcpy (&records[i].name, records[i].name - sizeof (char *), sizeof (char *));
+	arena_release (&key_arena);
+}
@@ -0,0 +1,360 @@
+/*
+ * External merge sort for the record_sort example
+ *
+ * For datafiles that don't fit in memory.  The input is read in chunks
+ * that fit in the memory limit, each chunk is sorted and spilled to a
+ * temporary run file, and the runs are merged with a heap into the
+ * write_sorted() output format.  When there are more runs than the
+ * memory limit allows buffers for, they are merged in several passes.
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.
+ * If not, see <https://www.gnu.org/licenses/>
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+#include <fcntl.h>
+
+#include "record_sort.h"
+
+/*
+ * Read buffer sizes for runs during the merge, and the smallest memory
+ * limit that leaves room for a useful chunk
+ */
+#define RUN_BUFFER (64*1024)
+#define MAX_RUN_BUFFER (8*1024*1024)
+#define MIN_MEM_LIMIT (4*ARENA_CHUNK)
+
+typedef struct {
+	int fd;			// unlinked temporary file holding the run
+	FILE *file;
+	char *buf;
+	reader_t rd;
+	record_t rec;
+	int seq;		// run number, breaks ties so the merge is stable
+} run_t;
+
+static int new_run (run_t *run, int seq)
+/*
+ * Create an anonymous temporary file for a run.  The name is unlinked
+ * straight away so nothing is left behind if the sort is interrupted.
+ */
+{
+	char path[4096];
+	const char *dir = getenv ("TMPDIR");
+
+	run->file = NULL;
+	run->buf = NULL;
+	run->seq = seq;
+	snprintf (path, sizeof (path), "%s/record_sort.XXXXXX", dir ? dir : "/tmp");
+	if ((run->fd = mkstemp (path)) < 0)
+		return -1;
+	unlink (path);
+	return 0;
+}
+
+static FILE *open_run (run_t *run, const char *mode, size_t bufsize)
+/*
+ * Open a stdio stream on the run's file with a bufsize buffer
+ */
+{
+	int fd = dup (run->fd);
+
+	if (fd < 0)
+		return NULL;
+	lseek (fd, 0, SEEK_SET);
+	if ((run->file = fdopen (fd, mode)) == NULL)
+	{
+		close (fd);
+		return NULL;
+	}
+	run->buf = malloc (bufsize);
+	setvbuf (run->file, run->buf, run->buf ? _IOFBF : _IONBF, bufsize);
+	if (*mode == 'r')
+		posix_fadvise (fd, 0, 0, POSIX_FADV_SEQUENTIAL);
+	return run->file;
+}
+
+static void close_run (run_t *run)
+{
+	if (run->file)
+		fclose (run->file);
+	free (run->buf);
+	run->file = NULL;
+	run->buf = NULL;
+}
+
+static int spill (run_t *run, int seq, int size, record_t records[], size_t bufsize)
+/*
+ * Write a sorted chunk out as a run
+ */
+{
+	int i;
+
+	if (new_run (run, seq))
+		return -1;
+	if (open_run (run, "w", bufsize) == NULL)
+	{
+		close (run->fd);
+		return -1;
+	}
+	for (i = 0; i < size; i++)
+		fprintf (run->file, "%s %u\n", records[i].name, records[i].ID);
+	if (fflush (run->file) != 0)
+	{
+		close_run (run);
+		close (run->fd);
+		return -1;
+	}
+	close_run (run);
+	return 0;
+}
+
+static int run_less (run_t *a, run_t *b, int key)
+{
+	if (record_less (&a->rec, &b->rec, key))
+		return 1;
+	if (record_less (&b->rec, &a->rec, key))
+		return 0;
+	return a->seq < b->seq;
+}
+
+static void sift_down (run_t *heap[], int n, int i, int key)
+{
+	run_t *top = heap[i];
+	int child;
+
+	while ((child = 2*i + 1) < n)
+	{
+		if (child + 1 < n && run_less (heap[child + 1], heap[child], key))
+			child++;
+		if (!run_less (heap[child], top, key))
+			break;
+		heap[i] = heap[child];
+		i = child;
+	}
+	heap[i] = top;
+}
+
+static void drop_runs (run_t runs[], int n)
+/*
+ * Close the files of runs that are no longer needed
+ */
+{
+	int i;
+
+	for (i = 0; i < n; i++)
+		close (runs[i].fd);
+}
+
+static int merge_runs (run_t runs[], int n, FILE *out, writer_t *final,
+	int key, size_t bufsize)
+/*
+ * k-way merge of n runs, either into out as another run or, when final
+ * is given, through that writer in the write_sorted() format.  Each run
+ * is read back through a bufsize buffer, which is freed again whether
+ * or not the merge worked; the runs' files are left to the caller.
+ */
+{
+	run_t **heap;
+	int i, opened, got, live = 0, result = 0;
+
+	if ((heap = malloc (n*sizeof (run_t *))) == NULL)
+		return -1;
+	for (opened = 0; opened < n; opened++)
+	{
+		if (open_run (&runs[opened], "r", bufsize) == NULL)
+		{
+			result = -1;
+			break;
+		}
+		open_reader (&runs[opened].rd, runs[opened].file);
+		if ((got = next_record (&runs[opened].rd, &runs[opened].rec)) < 0)
+		{
+			opened++;
+			result = -1;
+			break;
+		}
+		if (got > 0)
+			heap[live++] = &runs[opened];
+	}
+	if (result == 0)
+	{
+		for (i = live/2 - 1; i >= 0; i--)
+			sift_down (heap, live, i, key);
+
+		while (live > 0)
+		{
+			run_t *top = heap[0];
+
+			if (final)
+				put_record (final, top->rec.name, top->rec.ID);
+			else
+				fprintf (out, "%s %u\n", top->rec.name, top->rec.ID);
+			if ((got = next_record (&top->rd, &top->rec)) < 0)
+			{
+				result = -1;
+				break;
+			}
+			if (got == 0)
+				heap[0] = heap[--live];
+			sift_down (heap, live, 0, key);
+		}
+	}
+
+	for (i = 0; i < opened; i++)
+		close_reader (&runs[i].rd);
+	for (i = 0; i < n; i++)
+		close_run (&runs[i]);
+	free (heap);
+	return result;
+}
+
+int ext_sort (char *filename, int out, sort_fn sorter, int key,
+	size_t mem_limit, int jobs, int verbose)
+/*
+ * Sort filename to the out descriptor keeping the records, names and
+ * sort scratch space of each chunk under mem_limit bytes.
+ *
+ * Returns 0, or -1 if the file can't be read or a run or the output
+ * can't be written.
+ */
+{
+	FILE *file;
+	reader_t rd;
+	record_t rec, *chunk;
+	run_t *runs = NULL, *grown;
+	int i, n, nruns = 0, have, fan_in, pass = 0;
+	size_t cap, len, budget, bufsize;
+	writer_t w;
+	double start = now_ms ();
+
+	if ((file = fopen (filename, "r")) == NULL)
+		return -1;
+	if (mem_limit < MIN_MEM_LIMIT)
+		mem_limit = MIN_MEM_LIMIT;
+
+	// Half the limit goes to the records array, the radix sort's copy
+	// of it and its digit bytes; the other half to names
+	cap = mem_limit/2/(2*sizeof (record_t) + 1);
+	budget = mem_limit - cap*(2*sizeof (record_t) + 1);
+	if ((chunk = malloc (cap*sizeof (record_t))) == NULL)
+	{
+		fclose (file);
+		return -1;
+	}
+	setvbuf (file, NULL, _IOFBF, RUN_BUFFER);
+	open_reader (&rd, file);
+
+	have = next_record (&rd, &rec);
+	while (have > 0)
+	{
+		// The arena may need one more chunk for the next name
+		for (n = 0; have > 0 && (size_t) n < cap; n++)
+		{
+			len = strlen (rec.name);
+			if (n > 0 && name_arena.used + len + 1 + ARENA_CHUNK > budget)
+				break;
+			if ((chunk[n].name = arena_strndup (&name_arena, rec.name, len)) == NULL)
+				break;
+			chunk[n].ID = rec.ID;
+			have = next_record (&rd, &rec);
+		}
+		if (n == 0 || have < 0)
+		{
+			have = -1;
+			break;
+		}
+		par_sort (n, chunk, sorter, key, jobs, 0);
+
+		if ((grown = realloc (runs, (nruns + 1)*sizeof (run_t))) != NULL)
+			runs = grown;
+		if (grown == NULL || spill (&runs[nruns], nruns, n, chunk, RUN_BUFFER))
+		{
+			perror ("record_sort: run file");
+			have = -1;
+			break;
+		}
+		nruns++;
+		arena_release (&name_arena);
+	}
+	close_reader (&rd);
+	fclose (file);
+	free (chunk);
+	if (verbose)
+		fprintf (stderr, "%d runs written in %.3f ms\n", nruns, now_ms () - start);
+	if (have < 0)
+	{
+		arena_release (&name_arena);
+		drop_runs (runs, nruns);
+		free (runs);
+		return -1;
+	}
+
+	// Merge fan_in runs at a time until one pass can finish the job,
+	// giving each run an equal share of what the output buffer leaves
+	fan_in = (mem_limit - OUT_BUFFER)/RUN_BUFFER - 1;
+	while (nruns > fan_in)
+	{
+		int out = 0;
+
+		for (i = 0; i < nruns; i += fan_in)
+		{
+			run_t merged;
+			int k = nruns - i < fan_in ? nruns - i : fan_in;
+
+			if (new_run (&merged, out) || open_run (&merged, "w", RUN_BUFFER) == NULL
+				|| merge_runs (&runs[i], k, merged.file, NULL, key, RUN_BUFFER)
+				|| fflush (merged.file) != 0)
+			{
+				perror ("record_sort: run file");
+				// The merged runs so far and those not merged yet
+				drop_runs (runs, out);
+				drop_runs (&runs[i], nruns - i);
+				close_run (&merged);
+				if (merged.fd >= 0)
+					close (merged.fd);
+				free (runs);
+				return -1;
+			}
+			close_run (&merged);
+			drop_runs (&runs[i], k);
+			runs[out++] = merged;
+		}
+		nruns = out;
+		pass++;
+	}
+
+	start = now_ms ();
+	bufsize = (mem_limit - OUT_BUFFER)/(nruns + 1);
+	if (bufsize > MAX_RUN_BUFFER)
+		bufsize = MAX_RUN_BUFFER;
+	if (open_writer (&w, out))
+		have = -1;
+	else
+	{
+		if (nruns > 0 && merge_runs (runs, nruns, NULL, &w, key, bufsize))
+			have = -1;
+		if (close_writer (&w))
+			have = -1;
+	}
+	drop_runs (runs, nruns);
+	if (verbose)
+		fprintf (stderr, "merged in %d passes, final pass %.3f ms, name arena peak %zu\n",
+			pass + 1, now_ms () - start, name_arena.peak);
+	free (runs);
+	return have < 0 ? -1 : 0;
+}
@@ -0,0 +1,231 @@
+/*
+ * gen_datafile.c
+ *
+ * Synthetic datafile generator for benchmarking record_sort.
+ *
+ * Writes N records in the datafile format, "name ID" per line.  The
+ * output depends only on the options and the seed, so the same command
+ * gives the same file on every machine and every run.
+ *
+ * Usage: gen_datafile [-n N] [-s SEED] [-l MIN:MAX[:skew]] [-i MAX_ID]
+ *                     [-d DUP] [-p SORTED] [-o FILE]
+ *
+ *   -n N          number of records, k and M suffixes allowed (10k)
+ *   -s SEED       random seed (1)
+ *   -l MIN:MAX    name lengths, uniform between MIN and MAX (4:20),
+ *                 or with :skew, each length three quarters as common
+ *                 as the one before it
+ *   -i MAX_ID     IDs are drawn from 0 to MAX_ID (999999999)
+ *   -d DUP        fraction of records that repeat a recent name (0)
+ *   -p SORTED     fraction of records, spread through the file, that
+ *                 form an ascending run on both name and ID (0)
+ *   -o FILE       write to FILE instead of stdout
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.
+ * If not, see <https://www.gnu.org/licenses/>
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <stdint.h>
+#include <string.h>
+#include <unistd.h>
+
+#define USAGE "Usage: %s [-n N] [-s SEED] [-l MIN:MAX[:skew]] [-i MAX_ID] " \
+	"[-d DUP] [-p SORTED] [-o FILE]\n"
+
+/*
+ * Longest name generated, and how many recent names -d draws from
+ */
+#define MAX_NAME 255
+#define RECENT 4096
+
+/*
+ * Width of the base-26 counter that starts each name of the sorted run,
+ * enough for 26^6 = 308M records
+ */
+#define SORTED_DIGITS 6
+
+static uint64_t rng_state;
+
+static uint64_t next_random (void)
+/*
+ * splitmix64, so the sequence is the same on every libc
+ */
+{
+	uint64_t z = (rng_state += 0x9e3779b97f4a7c15ULL);
+
+	z = (z ^ (z >> 30))*0xbf58476d1ce4e5b9ULL;
+	z = (z ^ (z >> 27))*0x94d049bb133111ebULL;
+	return z ^ (z >> 31);
+}
+
+static uint64_t random_below (uint64_t n)
+{
+	return n ? next_random () % n : 0;
+}
+
+static double random_unit (void)
+{
+	return (next_random () >> 11)*(1.0/9007199254740992.0);
+}
+
+static long parse_count (char *arg)
+/*
+ * Count with an optional k or M suffix
+ */
+{
+	char *end;
+	long n = strtol (arg, &end, 10);
+
+	if (*end == 'k' || *end == 'K')
+		n *= 1000;
+	else if (*end == 'm' || *end == 'M')
+		n *= 1000000;
+	return n;
+}
+
+static int name_length (int min, int max, int skew)
+{
+	int len = min;
+
+	if (!skew)
+		return min + random_below (max - min + 1);
+	// Each further byte is three quarters as likely
+	while (len < max && (next_random () & 3) != 0)
+		len++;
+	return len;
+}
+
+static void random_name (char *name, int len)
+/*
+ * Capitalised letters with an underscore in the middle, like Brady_James
+ */
+{
+	int i;
+
+	for (i = 0; i < len; i++)
+		name[i] = 'a' + random_below (26);
+	name[0] = 'A' + random_below (26);
+	if (len >= 5)
+	{
+		name[len/2] = '_';
+		name[len/2 + 1] += 'A' - 'a';
+	}
+	name[len] = '\0';
+}
+
+static void sorted_name (char *name, int len, long seq)
+/*
+ * A name that sorts after the one for seq - 1: a fixed-width base-26
+ * count, padded with random letters to len
+ */
+{
+	int i;
+
+	if (len < SORTED_DIGITS)
+		len = SORTED_DIGITS;
+	for (i = SORTED_DIGITS - 1; i >= 0; i--)
+	{
+		name[i] = 'a' + seq%26;
+		seq /= 26;
+	}
+	name[0] += 'A' - 'a';
+	for (i = SORTED_DIGITS; i < len; i++)
+		name[i] = 'a' + random_below (26);
+	name[len] = '\0';
+}
+
+int main (int argc, char **argv)
+{
+	long n = 10000, i, seq = 0;
+	int opt, min = 4, max = 20, skew = 0, len;
+	unsigned long max_id = 999999999, id;
+	double dup = 0, sorted = 0, quota = 0;
+	char *output = NULL, *p;
+	char name[MAX_NAME + 1];
+	static char recent[RECENT][MAX_NAME + 1];
+	long nrecent = 0;
+	FILE *out = stdout;
+
+	rng_state = 1;
+	while ((opt = getopt (argc, argv, "n:s:l:i:d:p:o:")) != -1)
+	{
+		switch (opt)
+		{
+			case 'n': n = parse_count (optarg);
+			break;
+			case 's': rng_state = strtoull (optarg, NULL, 10);
+			break;
+			case 'l':
+			min = strtol (optarg, &p, 10);
+			max = *p == ':' ? strtol (p + 1, &p, 10) : min;
+			skew = strcmp (p, ":skew") == 0;
+			break;
+			case 'i': max_id = strtoul (optarg, NULL, 10);
+			break;
+			case 'd': dup = atof (optarg);
+			break;
+			case 'p': sorted = atof (optarg);
+			break;
+			case 'o': output = optarg;
+			break;
+			default:
+			fprintf (stderr, USAGE, argv[0]);
+			exit (2);
+		}
+	}
+	if (n < 0 || min < 1 || max < min || max > MAX_NAME)
+	{
+		fprintf (stderr, USAGE, argv[0]);
+		exit (2);
+	}
+	if (output && (out = fopen (output, "w")) == NULL)
+	{
+		fprintf (stderr, "Couldn't create file %s\n", output);
+		exit (1);
+	}
+	setvbuf (out, NULL, _IOFBF, 1 << 20);
+
+	for (i = 0; i < n; i++)
+	{
+		len = name_length (min, max, skew);
+		// Every 1/sorted-th record continues the ascending run
+		quota += sorted;
+		if (quota >= 1)
+		{
+			quota -= 1;
+			sorted_name (name, len, seq);
+			id = (unsigned long) ((double) seq/(n*sorted)*max_id);
+			seq++;
+		}
+		else
+		{
+			if (nrecent > 0 && random_unit () < dup)
+				strcpy (name, recent[random_below (nrecent < RECENT ? nrecent : RECENT)]);
+			else
+				random_name (name, len);
+			id = random_below ((uint64_t) max_id + 1);
+		}
+		strcpy (recent[nrecent++ % RECENT], name);
+		fprintf (out, "%s %lu\n", name, id);
+	}
+
+	if (fclose (out) != 0)
+	{
+		perror ("gen_datafile");
+		exit (1);
+	}
+	return 0;
+}
@@ -0,0 +1,247 @@
+/*
+ * Group-by-ID and dedup for the record_sort example
+ *
+ * Records are grouped on ID with an open-addressing hash table rather
+ * than a sort.  The table has a power of two number of slots, at least
+ * twice the record count, so it is at most half full; IDs are spread
+ * over it with Fibonacci hashing and collisions are resolved by linear
+ * probing.  Each slot holds the first and last record of its group,
+ * and the records of a group are chained through a next array in input
+ * order, so grouping is one pass over the records and no record moves.
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.
+ * If not, see <https://www.gnu.org/licenses/>
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <stdint.h>
+#include <string.h>
+#include <unistd.h>
+
+#include "record_sort.h"
+
+typedef struct {
+	uint32_t ID;
+	int32_t first;		// first record with ID, -1 for an empty slot
+	int32_t last;
+	int32_t count;
+} id_slot_t;
+
+typedef struct {
+	id_slot_t *slots;
+	int32_t *next;		// next record with the same ID, -1 at the end
+	int32_t *order;		// slot of each group, in order of first sight
+	size_t mask;
+	int shift;
+	int groups;
+	uint64_t probes;	// slots looked at, over all records
+	int max_probe;
+} id_table_t;
+
+static inline size_t id_hash (id_table_t *t, uint32_t ID)
+{
+	return (uint32_t) (ID*0x9e3779b9u) >> t->shift;
+}
+
+static void free_table (id_table_t *t)
+{
+	free (t->slots);
+	free (t->next);
+	free (t->order);
+}
+
+static int group_records (id_table_t *t, int size, record_t records[])
+/*
+ * Group records on ID.  Returns 0, or -1 if memory ran out.
+ */
+{
+	size_t nslots = 1, s;
+	int bits = 0, i, probe;
+
+	while (nslots < 2*(size_t) size)
+	{
+		nslots <<= 1;
+		bits++;
+	}
+	if (bits == 0)
+	{
+		nslots = 2;
+		bits = 1;
+	}
+	memset (t, 0, sizeof (*t));
+	t->mask = nslots - 1;
+	t->shift = 32 - bits;
+	t->slots = malloc (nslots*sizeof (id_slot_t));
+	t->next = malloc ((size + 1)*sizeof (int32_t));
+	t->order = malloc ((size + 1)*sizeof (int32_t));
+	if (t->slots == NULL || t->next == NULL || t->order == NULL)
+	{
+		free_table (t);
+		return -1;
+	}
+	for (s = 0; s < nslots; s++)
+		t->slots[s].first = -1;
+
+	for (i = 0; i < size; i++)
+	{
+		s = id_hash (t, records[i].ID);
+		for (probe = 1; t->slots[s].first >= 0 && t->slots[s].ID != records[i].ID; probe++)
+			s = (s + 1) & t->mask;
+
+		if (t->slots[s].first < 0)
+		{
+			t->slots[s].ID = records[i].ID;
+			t->slots[s].first = i;
+			t->slots[s].count = 0;
+			t->order[t->groups++] = s;
+		}
+		else
+			t->next[t->slots[s].last] = i;
+		t->slots[s].last = i;
+		t->slots[s].count++;
+		t->next[i] = -1;
+
+		t->probes += probe;
+		if (probe > t->max_probe)
+			t->max_probe = probe;
+	}
+	return 0;
+}
+
+static int name_seen (const char *set[], size_t mask, const char *name)
+/*
+ * Add name to the set of names of one group, an open-addressing table
+ * of mask + 1 slots hashed with FNV-1a.  Returns 1 if it was there
+ * already.
+ */
+{
+	const unsigned char *p;
+	uint32_t h = 2166136261u;
+	size_t s;
+
+	for (p = (const unsigned char *) name; *p; p++)
+		h = (h ^ *p)*16777619u;
+	for (s = h & mask; set[s] != NULL; s = (s + 1) & mask)
+		if (strcmp (set[s], name) == 0)
+			return 1;
+	set[s] = name;
+	return 0;
+}
+
+static void print_stats (id_table_t *t, int size, double ms)
+{
+	fprintf (stderr, "%d records in %d IDs grouped in %.3f ms; "
+		"table %zu slots, load %.2f, probes avg %.2f max %d\n",
+		size, t->groups, ms, t->mask + 1, (double) t->groups/(t->mask + 1),
+		size ? (double) t->probes/size : 0.0, t->max_probe);
+}
+
+int group_report (int size, record_t records[], int fd)
+/*
+ * Count the records for each ID and print the IDs that have more than
+ * one to the fd descriptor, in order of first sight, with their names
+ * when the names disagree.  A summary and the hash table's probe
+ * statistics go to stderr.  Returns 0, or -1 if memory ran out or the
+ * report couldn't be written.
+ */
+{
+	id_table_t t;
+	id_slot_t *slot;
+	FILE *out;
+	const char **names = NULL, **grown;
+	size_t nslots, cap = 0;
+	int g, i, dups = 0, conflicts = 0;
+	double start = now_ms ();
+
+	if ((out = fdopen (dup (fd), "w")) == NULL)
+		return -1;
+	if (group_records (&t, size, records))
+	{
+		fclose (out);
+		return -1;
+	}
+	setvbuf (out, NULL, _IOFBF, OUT_BUFFER);
+	print_stats (&t, size, now_ms () - start);
+
+	for (g = 0; g < t.groups; g++)
+	{
+		slot = &t.slots[t.order[g]];
+		if (slot->count < 2)
+			continue;
+		dups++;
+		for (i = t.next[slot->first]; i >= 0; i = t.next[i])
+			if (strcmp (records[i].name, records[slot->first].name) != 0)
+				break;
+		if (i < 0)
+		{
+			fprintf (out, "%u: %d records, %s\n", slot->ID, slot->count,
+				records[slot->first].name);
+			continue;
+		}
+
+		// List each distinct name once, in order of first sight, through
+		// a set at most half full, so a large group stays linear
+		for (nslots = 2; nslots < 2*(size_t) slot->count; nslots <<= 1)
+			;
+		if (nslots > cap)
+		{
+			if ((grown = realloc (names, nslots*sizeof (*names))) == NULL)
+			{
+				free (names);
+				free_table (&t);
+				fclose (out);
+				return -1;
+			}
+			names = grown;
+			cap = nslots;
+		}
+		memset (names, 0, nslots*sizeof (*names));
+		conflicts++;
+		fprintf (out, "%u: %d records, conflicting names:", slot->ID, slot->count);
+		for (i = slot->first; i >= 0; i = t.next[i])
+			if (!name_seen (names, nslots - 1, records[i].name))
+				fprintf (out, " %s", records[i].name);
+		fputc ('\n', out);
+	}
+	free (names);
+	free_table (&t);
+	fprintf (stderr, "%d IDs with duplicates, %d of them with conflicting names\n",
+		dups, conflicts);
+	return fclose (out) == 0 ? 0 : -1;
+}
+
+int dedup_records (int size, record_t records[], int verbose)
+/*
+ * Keep the first record for each ID, in input order, and return how
+ * many are left, or -1 if memory ran out.
+ */
+{
+	id_table_t t;
+	int g;
+	double start = now_ms ();
+
+	if (group_records (&t, size, records))
+		return -1;
+	if (verbose)
+		print_stats (&t, size, now_ms () - start);
+
+	// Groups are in order of first sight, so each first record is at or
+	// after the position it moves to
+	for (g = 0; g < t.groups; g++)
+		records[g] = records[t.slots[t.order[g]].first];
+	g = t.groups;
+	free_table (&t);
+	return g;
+}
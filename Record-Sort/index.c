@@ -0,0 +1,340 @@
+/*
+ * Persistent sorted indexes for the record_sort example
+ *
+ * Two index files are kept next to a text datafile, DATAFILE.name.idx
+ * and DATAFILE.id.idx.  Each holds the datafile's records in sorted
+ * order as (offset, length, ID) entries, together with how much of the
+ * datafile it covers.  When the datafile has grown by appending, only
+ * the appended tail is parsed and sorted, and it is merged into the
+ * existing index.  Only whole lines are indexed: a last line without
+ * a newline may still be appended to, so it is parsed again each run.
+ *
+ * A datafile that was rewritten rather than appended to is caught by a
+ * checksum and re-indexed in full.  The checksum only covers the first
+ * and last IDX_CHECK_BYTES of the indexed span, so that checking it
+ * doesn't read the whole file; an edit that keeps the length and only
+ * changes bytes in between goes unnoticed.  Remove the index files
+ * after such an edit.
+ *
+ * Both the tail sort and the merge are stable, so the result is the
+ * same as a stable sort of the whole datafile.
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.
+ * If not, see <https://www.gnu.org/licenses/>
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <stdint.h>
+#include <string.h>
+#include <ctype.h>
+
+#include "record_sort.h"
+
+#define IDX_MAGIC "RECIDX01"
+
+/*
+ * Bytes at each end of the covered span that go into the checksum
+ */
+#define IDX_CHECK_BYTES 4096
+
+typedef struct {
+	char magic[8];
+	uint32_t key;
+	uint32_t count;
+	uint64_t data_bytes;	// length of the datafile prefix indexed
+	uint64_t checksum;	// of the first and last IDX_CHECK_BYTES of it
+} idx_header_t;
+
+typedef struct {
+	uint64_t offset;	// of the name in the datafile
+	uint32_t len;
+	uint32_t ID;
+} idx_entry_t;
+
+static uint64_t fnv1a (const char *p, size_t len, uint64_t hash)
+/*
+ * FNV-1a with every separator hashed as a space, so the sum doesn't
+ * change when names are terminated in place in the mapping
+ */
+{
+	unsigned char c;
+
+	while (len--)
+	{
+		c = *p++;
+		if (c == '\0' || isspace (c))
+			c = ' ';
+		hash ^= c;
+		hash *= 0x100000001b3ULL;
+	}
+	return hash;
+}
+
+static uint64_t span_checksum (const char *base, size_t len)
+{
+	uint64_t hash = 0xcbf29ce484222325ULL;
+
+	if (len <= 2*IDX_CHECK_BYTES)
+		return fnv1a (base, len, hash);
+	hash = fnv1a (base, IDX_CHECK_BYTES, hash);
+	return fnv1a (base + len - IDX_CHECK_BYTES, IDX_CHECK_BYTES, hash);
+}
+
+static int load_index (char *path, int key, char *base, size_t len,
+	int *size, record_t *records[], size_t *covered)
+/*
+ * Read an index and rebuild its records on the mapped datafile.
+ * Returns 0 with *size set to 0 when there is no usable index, so the
+ * caller re-indexes from the start, and -1 only if memory ran out.
+ */
+{
+	FILE *file;
+	idx_header_t header;
+	idx_entry_t *entries;
+	record_t *temp;
+	uint32_t i;
+
+	*size = 0;
+	*records = NULL;
+	*covered = 0;
+	if ((file = fopen (path, "r")) == NULL)
+		return 0;
+	if (fread (&header, sizeof (header), 1, file) != 1
+		|| memcmp (header.magic, IDX_MAGIC, sizeof (header.magic)) != 0
+		|| header.key != (uint32_t) key
+		|| header.count > INT32_MAX
+		|| header.data_bytes > len
+		|| header.checksum != span_checksum (base, header.data_bytes))
+	{
+		fclose (file);
+		return 0;
+	}
+
+	entries = malloc (header.count*sizeof (idx_entry_t) + 1);
+	temp = malloc (header.count*sizeof (record_t) + 1);
+	if (entries == NULL || temp == NULL)
+	{
+		free (entries);
+		free (temp);
+		fclose (file);
+		return -1;
+	}
+	if (fread (entries, sizeof (idx_entry_t), header.count, file) != header.count)
+	{
+		free (entries);
+		free (temp);
+		fclose (file);
+		return 0;
+	}
+	fclose (file);
+
+	for (i = 0; i < header.count; i++)
+	{
+		char *name = base + entries[i].offset;
+
+		if (entries[i].offset + entries[i].len >= header.data_bytes)
+		{
+			free (entries);
+			free (temp);
+			return 0;
+		}
+		name[entries[i].len] = '\0';
+		temp[i].name = name;
+		temp[i].ID = entries[i].ID;
+	}
+	free (entries);
+
+	*size = header.count;
+	*records = temp;
+	*covered = header.data_bytes;
+	return 0;
+}
+
+static int save_index (char *path, int key, char *base, size_t covered,
+	int size, record_t records[])
+/*
+ * Write an index through a temporary file renamed into place, so a
+ * crash never leaves a half-written index behind
+ */
+{
+	char tmp_path[4096 + 8];
+	idx_header_t header;
+	idx_entry_t entry;
+	FILE *file;
+	int i;
+
+	snprintf (tmp_path, sizeof (tmp_path), "%s.tmp", path);
+	if ((file = fopen (tmp_path, "w")) == NULL)
+		return -1;
+	setvbuf (file, NULL, _IOFBF, 1 << 20);
+
+	memset (&header, 0, sizeof (header));
+	memcpy (header.magic, IDX_MAGIC, sizeof (header.magic));
+	header.key = key;
+	header.count = size;
+	header.data_bytes = covered;
+	header.checksum = span_checksum (base, covered);
+	fwrite (&header, sizeof (header), 1, file);
+
+	for (i = 0; i < size; i++)
+	{
+		entry.offset = records[i].name - base;
+		entry.len = strlen (records[i].name);
+		entry.ID = records[i].ID;
+		fwrite (&entry, sizeof (entry), 1, file);
+	}
+	// Check for a short write before the rename, so a partial index
+	// never replaces a good one
+	if ((ferror (file) | fclose (file)) != 0 || rename (tmp_path, path) != 0)
+	{
+		remove (tmp_path);
+		return -1;
+	}
+	return 0;
+}
+
+static record_t *merge_records (int n1, record_t a[], int n2, record_t b[],
+	int key)
+/*
+ * Stable merge of two sorted arrays into a new one; a comes first on ties
+ */
+{
+	record_t *out;
+	int i = 0, j = 0, k = 0;
+
+	if ((out = malloc ((n1 + n2)*sizeof (record_t) + 1)) == NULL)
+		return NULL;
+	while (i < n1 && j < n2)
+		out[k++] = record_less (&b[j], &a[i], key) ? b[j++] : a[i++];
+	memcpy (out + k, a + i, (n1 - i)*sizeof (record_t));
+	memcpy (out + k + n1 - i, b + j, (n2 - j)*sizeof (record_t));
+	return out;
+}
+
+static int update_index (char *filename, int key, sort_fn sorter, int jobs,
+	char *base, size_t len, int *size, record_t *records[], int verbose)
+/*
+ * Bring one index up to date with the datafile and return its records
+ * in sorted order
+ */
+{
+	char path[4096];
+	int old_size, delta_size, rest_size;
+	record_t *old, *delta, *merged, *rest, *all;
+	size_t covered;
+	char *stop, *lines;
+	double start = now_ms ();
+
+	snprintf (path, sizeof (path), "%s.%s.idx", filename,
+		key == SORT_ID ? "id" : "name");
+	if (load_index (path, key, base, len, &old_size, &old, &covered))
+		return -1;
+	// Index up to the last newline only
+	lines = base + len;
+	while (lines > base + covered && lines[-1] != '\n')
+		lines--;
+	if (par_scan (base + covered, lines, jobs, &delta_size, &delta, &stop))
+	{
+		free (old);
+		return -1;
+	}
+	par_sort (delta_size, delta, sorter, key, jobs, 0);
+
+	if (old_size == 0)
+	{
+		free (old);
+		merged = delta;
+	}
+	else
+	{
+		merged = merge_records (old_size, old, delta_size, delta, key);
+		free (old);
+		free (delta);
+		if (merged == NULL)
+			return -1;
+	}
+
+	if (delta_size > 0 || old_size == 0)
+		if (save_index (path, key, base, stop - base, old_size + delta_size, merged))
+			fprintf (stderr, "record_sort: couldn't write index %s\n", path);
+
+	// Records the index doesn't cover yet: an unterminated last line, or
+	// one whose ID is on that line
+	if (scan_span (stop, base + len, &rest_size, &rest, NULL))
+	{
+		free (merged);
+		return -1;
+	}
+	if (rest_size == 0)
+		all = merged;
+	else
+	{
+		sorter (rest_size, rest);
+		all = merge_records (old_size + delta_size, merged, rest_size, rest, key);
+		free (merged);
+		if (all == NULL)
+		{
+			free (rest);
+			return -1;
+		}
+	}
+	free (rest);
+
+	*size = old_size + delta_size + rest_size;
+	*records = all;
+	if (verbose)
+		fprintf (stderr, "%s: %d indexed records, %d appended, %d unterminated, %.3f ms\n",
+			path, old_size, delta_size, rest_size, now_ms () - start);
+	return 0;
+}
+
+int index_sort (char *filename, int out, int key, int jobs, int verbose)
+/*
+ * Update both indexes of a text datafile and write its records sorted
+ * on key to the out descriptor.  Returns 0, or -1 if the datafile
+ * can't be mapped, memory runs out, or the output can't be written.
+ */
+{
+	size_t len;
+	char *base;
+	int name_size, id_size, result;
+	record_t *by_name = NULL, *by_ID = NULL;
+
+	if ((base = map_text (filename, &len)) == NULL)
+		return -1;
+	if (update_index (filename, SORT_NAME, sort_name_radix, jobs, base, len,
+			&name_size, &by_name, verbose)
+		|| update_index (filename, SORT_ID, sort_ID_radix, jobs, base, len,
+			&id_size, &by_ID, verbose))
+	{
+		free (by_name);
+		release_mapping ();
+		return -1;
+	}
+
+	if (key == SORT_ID)
+	{
+		free (by_name);
+		result = write_records (out, id_size, by_ID);
+		return_records (id_size, by_ID);
+	}
+	else
+	{
+		free (by_ID);
+		result = write_records (out, name_size, by_name);
+		return_records (name_size, by_name);
+	}
+	return result;
+}
@@ -0,0 +1,170 @@
+/*
+ * Memory-mapped loader for the record_sort example
+ *
+ * The datafile is mapped privately and the record_t entries point
+ * straight into the mapping, so loading costs one array allocation
+ * and no per-record allocation or copy.
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.
+ * If not, see <https://www.gnu.org/licenses/>
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+
+#include "record_sort.h"
+
+/*
+ * The one live mapping, released by release_mapping().  map_binary()
+ * hands its mapping over with keep_mapping().
+ */
+static char *map_base = NULL;
+static size_t map_span = 0;
+
+char *map_text (char *filename, size_t *len)
+/*
+ * Map a text datafile privately and writably, so names can be
+ * terminated in place without modifying the file, and keep the mapping
+ * until release_mapping().  Returns the base address and sets *len to
+ * the file size, or returns NULL if the file can't be mapped.
+ *
+ * The mapping is reserved one page larger than the file so there is
+ * always a zero byte past the last record, even when the file ends
+ * on a page boundary without a trailing newline.
+ */
+{
+	int fd;
+	size_t page, span;
+	struct stat st;
+	char *base;
+
+	if ((fd = open (filename, O_RDONLY)) < 0)
+		return NULL;
+	if (fstat (fd, &st) < 0)
+	{
+		close (fd);
+		return NULL;
+	}
+	*len = st.st_size;
+	page = sysconf (_SC_PAGESIZE);
+	span = (*len/page + 1)*page;
+
+	base = mmap (NULL, span, PROT_READ | PROT_WRITE,
+		MAP_PRIVATE | MAP_ANONYMOUS, -1, 0);
+	if (base == MAP_FAILED)
+	{
+		close (fd);
+		return NULL;
+	}
+	if (*len > 0 && mmap (base, *len, PROT_READ | PROT_WRITE,
+		MAP_PRIVATE | MAP_FIXED, fd, 0) == MAP_FAILED)
+	{
+		munmap (base, span);
+		close (fd);
+		return NULL;
+	}
+	close (fd);
+	madvise (base, *len, MADV_SEQUENTIAL);
+	keep_mapping (base, span);
+	return base;
+}
+
+int scan_span (char *p, char *end, int *size, record_t *records[], char **stop)
+/*
+ * Parse the records in p..end into a new array.  If stop isn't NULL it
+ * is set to where parsing stopped.  Returns 0, or -1 if the array
+ * couldn't be allocated or grown, in which case nothing is returned.
+ */
+{
+	size_t nrecs = 0, lines = 1;
+	char *q, *next;
+	record_t *temp, *grown;
+
+	// One pass with memchr to size the array, then one allocation
+	for (q = p; (q = memchr (q, '\n', end - q)) != NULL; q++)
+		lines++;
+	if ((temp = malloc (lines*sizeof (record_t))) == NULL)
+		return -1;
+
+	// Records normally sit one per line, but like fscanf the scanner
+	// doesn't insist on it, so grow the array if the guess was short
+	while ((next = scan_record (p, end, &temp[nrecs])) != NULL)
+	{
+		p = next;
+		if (++nrecs == lines)
+		{
+			lines *= 2;
+			if ((grown = realloc (temp, lines*sizeof (record_t))) == NULL)
+			{
+				free (temp);
+				return -1;
+			}
+			temp = grown;
+		}
+	}
+
+	if (stop != NULL)
+		*stop = p;
+	*size = nrecs;
+	*records = temp;
+	return 0;
+}
+
+int map_file (char *filename, int *size, record_t *records[])
+/*
+ * Maps a datafile in the same format read_file() accepts and builds
+ * the records array on top of it.  The file itself is never modified.
+ */
+{
+	size_t len;
+	char *base;
+
+	if ((base = map_text (filename, &len)) == NULL)
+		return -1;
+	if (scan_span (base, base + len, size, records, NULL))
+	{
+		release_mapping ();
+		return -1;
+	}
+	return 0;
+}
+
+void keep_mapping (char *base, size_t span)
+/*
+ * Take ownership of a mapping the records point into
+ */
+{
+	release_mapping ();
+	map_base = base;
+	map_span = span;
+}
+
+int release_mapping (void)
+/*
+ * Unmap the file mapped by map_file() or map_binary().  Returns 1 if
+ * there was a mapping to release, 0 otherwise.
+ */
+{
+	if (map_base == NULL)
+		return 0;
+	munmap (map_base, map_span);
+	map_base = NULL;
+	map_span = 0;
+	return 1;
+}
@@ -0,0 +1,220 @@
+/*
+ * Multi-threaded parsing of mapped text datafiles for the record_sort
+ * example
+ *
+ * The mapping is cut into one chunk per worker, each cut moved forward
+ * to just after a newline.  The workers first count the newlines in
+ * their chunks with memchr, which bounds how many records each chunk can
+ * hold; a prefix sum of the counts gives every chunk its own slice of a
+ * single records array, and the workers then parse straight into their
+ * slices.  Slices are only moved down where blank or short lines left
+ * gaps, so the records are never copied a second time in the normal
+ * case.
+ *
+ * The result is the same as scan_span() over the whole span.  A chunk
+ * that doesn't parse to its end, for a malformed line or a record split
+ * across lines, ends the parallel part and the rest is parsed serially
+ * from there, as scan_span() would.
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.
+ * If not, see <https://www.gnu.org/licenses/>
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <ctype.h>
+#include <pthread.h>
+
+#include "record_sort.h"
+
+/*
+ * Spans are cut into chunks no smaller than this; a span too small for
+ * two is parsed on the calling thread
+ */
+#define MIN_CHUNK (1 << 20)
+
+typedef struct {
+	char *p, *end;		// the chunk
+	record_t *out;		// its slice of the records array
+	int cap;		// room in the slice
+	int n;			// records parsed
+	char *stop;		// where parsing stopped
+} parse_job_t;
+
+static void *count_chunk (void *arg)
+{
+	parse_job_t *job = arg;
+	char *q;
+
+	job->cap = 0;
+	for (q = job->p; (q = memchr (q, '\n', job->end - q)) != NULL; q++)
+		job->cap++;
+	return NULL;
+}
+
+static void *parse_chunk (void *arg)
+{
+	parse_job_t *job = arg;
+	char *p = job->p, *next;
+
+	job->n = 0;
+	while (job->n < job->cap
+		&& (next = scan_record (p, job->end, &job->out[job->n])) != NULL)
+	{
+		p = next;
+		job->n++;
+	}
+	job->stop = p;
+	return NULL;
+}
+
+static int parsed_to_end (parse_job_t *job)
+{
+	char *p = job->stop;
+
+	while (p < job->end && (isspace ((unsigned char) *p) || *p == '\0'))
+		p++;
+	return p == job->end;
+}
+
+static void run_jobs (void *(*fn) (void *), parse_job_t jobs[], int n)
+/*
+ * Run fn on every job, one thread each.  A job whose thread can't be
+ * started runs on the calling thread.
+ */
+{
+	pthread_t threads[MAX_JOBS];
+	int started[MAX_JOBS];
+	int i;
+
+	for (i = 1; i < n; i++)
+		started[i] = pthread_create (&threads[i], NULL, fn, &jobs[i]) == 0;
+	fn (&jobs[0]);
+	for (i = 1; i < n; i++)
+	{
+		if (started[i])
+			pthread_join (threads[i], NULL);
+		else
+			fn (&jobs[i]);
+	}
+}
+
+int par_scan (char *p, char *end, int jobs, int *size, record_t *records[],
+	char **stop)
+/*
+ * scan_span() with up to jobs threads.  Returns 0, or -1 if the array
+ * couldn't be allocated.
+ */
+{
+	parse_job_t parts[MAX_JOBS];
+	record_t *temp, *tail, *grown;
+	size_t span = end - p, total = 0;
+	int i, n = 0, tail_size;
+	char *q;
+
+	if (jobs > MAX_JOBS)
+		jobs = MAX_JOBS;
+	if ((size_t) jobs > span/MIN_CHUNK)
+		jobs = span/MIN_CHUNK;
+	if (jobs <= 1)
+		return scan_span (p, end, size, records, stop);
+
+	// Cut after the first newline past each even share of the span
+	for (i = 0; i < jobs; i++)
+	{
+		parts[i].p = i ? parts[i - 1].end : p;
+		q = p + span*(i + 1)/jobs;
+		if (i == jobs - 1 || q < parts[i].p)
+			q = i == jobs - 1 ? end : parts[i].p;
+		else if ((q = memchr (q, '\n', end - q)) == NULL)
+			q = end;
+		else
+			q++;
+		parts[i].end = q;
+	}
+
+	run_jobs (count_chunk, parts, jobs);
+	parts[jobs - 1].cap++;		// a last line without a newline
+	for (i = 0; i < jobs; i++)
+		total += parts[i].cap;
+	if (total > INT32_MAX || (temp = malloc ((total + 1)*sizeof (record_t))) == NULL)
+		return -1;
+	for (i = 0, total = 0; i < jobs; i++)
+	{
+		parts[i].out = temp + total;
+		total += parts[i].cap;
+	}
+
+	run_jobs (parse_chunk, parts, jobs);
+
+	// Close the gaps between slices, up to the first chunk that didn't
+	// parse to its end
+	for (i = 0; i < jobs; i++)
+	{
+		if (parts[i].out != temp + n)
+			memmove (temp + n, parts[i].out, parts[i].n*sizeof (record_t));
+		n += parts[i].n;
+		if (!parsed_to_end (&parts[i]))
+			break;
+	}
+
+	if (i == jobs)
+	{
+		if (stop != NULL)
+			*stop = parts[jobs - 1].stop;
+	}
+	else
+	{
+		// Names the later chunks terminated in place still scan the
+		// same, as '\0' is a separator to scan_record()
+		if (scan_span (parts[i].stop, end, &tail_size, &tail, stop))
+		{
+			free (temp);
+			return -1;
+		}
+		if ((grown = realloc (temp, (n + tail_size + 1)*sizeof (record_t))) == NULL)
+		{
+			free (tail);
+			free (temp);
+			return -1;
+		}
+		temp = grown;
+		memcpy (temp + n, tail, tail_size*sizeof (record_t));
+		n += tail_size;
+		free (tail);
+	}
+
+	*size = n;
+	*records = temp;
+	return 0;
+}
+
+int par_map_file (char *filename, int jobs, int *size, record_t *records[])
+/*
+ * map_file() with the records parsed by up to jobs threads
+ */
+{
+	size_t len;
+	char *base;
+
+	if ((base = map_text (filename, &len)) == NULL)
+		return -1;
+	if (par_scan (base, base + len, jobs, size, records, NULL))
+	{
+		release_mapping ();
+		return -1;
+	}
+	return 0;
+}
@@ -0,0 +1,229 @@
+/*
+ * Multi-threaded sort for the record_sort example
+ *
+ * The records array is cut into one partition per worker, each
+ * partition is sorted on its own thread, and the sorted partitions are
+ * merged pairwise.  Every merge round is itself split across all the
+ * workers by cutting the output at equal positions and finding the
+ * matching split point in each input with a binary search ("merge
+ * path"), so the last rounds don't fall back to a single thread.
+ *
+ * The merge is stable, so with a stable partition sort (radix) the
+ * result is identical to the single-threaded sort.
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.
+ * If not, see <https://www.gnu.org/licenses/>
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <pthread.h>
+
+#include "record_sort.h"
+
+typedef struct {
+	record_t *records;
+	int size;
+	sort_fn sorter;
+	double ms;
+} part_job_t;
+
+typedef struct {
+	record_t *src, *dst;
+	int *runs;		// run boundaries, nruns + 1 entries
+	int nruns;
+	int from, to;	// slice of the output this worker produces
+	int key;
+} merge_job_t;
+
+static void *sort_part (void *arg)
+{
+	part_job_t *job = arg;
+	double start = now_ms ();
+
+	job->sorter (job->size, job->records);
+	job->ms = now_ms () - start;
+	return NULL;
+}
+
+static int co_rank (int k, record_t a[], int m, record_t b[], int n, int key)
+/*
+ * Number of elements of a among the first k outputs of the stable
+ * merge of a (length m) and b (length n)
+ */
+{
+	int lo = k > n ? k - n : 0;
+	int hi = k < m ? k : m;
+
+	while (lo < hi)
+	{
+		int i = (lo + hi)/2;
+		int j = k - i;
+		if (j > 0 && i < m && !record_less (&b[j - 1], &a[i], key))
+			lo = i + 1;
+		else
+			hi = i;
+	}
+	return lo;
+}
+
+static void *merge_slice (void *arg)
+/*
+ * Produce dst[from..to) for one merge round.  The slice may span
+ * several pairs of runs; an unpaired last run is copied across.
+ */
+{
+	merge_job_t *job = arg;
+	int r, k;
+
+	for (r = 0; r < job->nruns; r += 2)
+	{
+		int lo = job->runs[r];
+		int mid = job->runs[r + 1];
+		int hi = job->runs[r + 2 <= job->nruns ? r + 2 : r + 1];
+		int k0, k1, i, j, i1, j1;
+		record_t *a, *b, *out;
+
+		if (hi <= job->from || lo >= job->to)
+			continue;
+		k0 = (job->from > lo ? job->from : lo) - lo;
+		k1 = (job->to < hi ? job->to : hi) - lo;
+
+		a = job->src + lo;
+		b = job->src + mid;
+		i = co_rank (k0, a, mid - lo, b, hi - mid, job->key);
+		i1 = co_rank (k1, a, mid - lo, b, hi - mid, job->key);
+		j = k0 - i;
+		j1 = k1 - i1;
+		out = job->dst + lo + k0;
+
+		for (k = k0; k < k1; k++)
+		{
+			if (j < j1 && (i == i1 || record_less (&b[j], &a[i], job->key)))
+				*out++ = b[j++];
+			else
+				*out++ = a[i++];
+		}
+	}
+	return NULL;
+}
+
+int par_sort (int size, record_t records[], sort_fn sorter, int key,
+	int jobs, int verbose)
+/*
+ * Sort records with jobs threads.  sorter sorts each partition and key,
+ * any key sorter accepts, orders the merge.  With verbose set the
+ * per-thread and per-phase times go to stderr.
+ *
+ * The records always end up sorted.  Returns 0, or -1 if the sort
+ * couldn't be run as asked: either the scratch buffer couldn't be had,
+ * and the records were sorted on the calling thread, or a worker
+ * couldn't be started, and its share was done on the calling thread.
+ */
+{
+	pthread_t threads[MAX_JOBS];
+	part_job_t parts[MAX_JOBS];
+	merge_job_t merges[MAX_JOBS];
+	int runs[MAX_JOBS + 1];
+	int i, nruns, round = 0, result = 0;
+	double start, sort_ms, merge_start, busy = 0;
+	record_t *tmp, *src, *dst;
+
+	if (jobs > MAX_JOBS)
+		jobs = MAX_JOBS;
+	if (jobs > size/2)
+		jobs = size/2;
+	if (jobs < 2)
+	{
+		sorter (size, records);
+		return 0;
+	}
+	if ((tmp = malloc (size*sizeof (record_t))) == NULL)
+	{
+		sorter (size, records);
+		return -1;
+	}
+
+	start = now_ms ();
+	for (i = 0; i <= jobs; i++)
+		runs[i] = (int) ((long long) size*i/jobs);
+	for (i = 0; i < jobs; i++)
+	{
+		parts[i].records = records + runs[i];
+		parts[i].size = runs[i + 1] - runs[i];
+		parts[i].sorter = sorter;
+		if (pthread_create (&threads[i], NULL, sort_part, &parts[i]))
+		{
+			sort_part (&parts[i]);
+			threads[i] = 0;
+			result = -1;
+		}
+	}
+	for (i = 0; i < jobs; i++)
+	{
+		if (threads[i])
+			pthread_join (threads[i], NULL);
+		busy += parts[i].ms;
+	}
+	sort_ms = now_ms () - start;
+
+	merge_start = now_ms ();
+	src = records;
+	dst = tmp;
+	for (nruns = jobs; nruns > 1; nruns = (nruns + 1)/2, round++)
+	{
+		for (i = 0; i < jobs; i++)
+		{
+			merges[i].src = src;
+			merges[i].dst = dst;
+			merges[i].runs = runs;
+			merges[i].nruns = nruns;
+			merges[i].from = (int) ((long long) size*i/jobs);
+			merges[i].to = (int) ((long long) size*(i + 1)/jobs);
+			merges[i].key = key;
+			if (pthread_create (&threads[i], NULL, merge_slice, &merges[i]))
+			{
+				merge_slice (&merges[i]);
+				threads[i] = 0;
+				result = -1;
+			}
+		}
+		for (i = 0; i < jobs; i++)
+			if (threads[i])
+				pthread_join (threads[i], NULL);
+
+		// Pairs of runs are now single runs
+		for (i = 0; 2*i < nruns; i++)
+			runs[i] = runs[2*i];
+		runs[i] = size;
+
+		dst = src;
+		src = src == records ? tmp : records;
+	}
+	if (src != records)
+		memcpy (records, src, size*sizeof (record_t));
+	free (tmp);
+
+	if (verbose)
+	{
+		for (i = 0; i < jobs; i++)
+			fprintf (stderr, "thread %d sorted %d records in %.3f ms\n",
+				i, parts[i].size, parts[i].ms);
+		fprintf (stderr, "%d threads: partition sort %.3f ms (%.2f cores busy), "
+			"merge %.3f ms in %d rounds\n", jobs, sort_ms, busy/sort_ms,
+			now_ms () - merge_start, round);
+	}
+	return result;
+}
@@ -0,0 +1,237 @@
+/*
+ * Per-phase instrumentation for the record_sort example
+ *
+ * With --profile FILE, each phase of a run (load, sort, write, ...) is
+ * measured and the results are written to FILE as JSON when the program
+ * exits:
+ *
+ *   {"counters":"ok","phases":[
+ *    {"phase":"load","wall_ms":180.2,"heap_bytes":27262976,
+ *     "heap_delta":27262976,"peak_rss_kb":61244,"minor_faults":6805,
+ *     "major_faults":0,"cycles":412345678,"instructions":987654321,
+ *     "cache_misses":1234567,"branch_misses":2345678}, ...]}
+ *
+ * heap_bytes is what malloc has handed out at the end of the phase and
+ * heap_delta its change over the phase; peak_rss_kb is the high-water
+ * mark of the process so far.  The hardware counters come from
+ * perf_event_open, counting user space only and following any threads
+ * the phase starts.  Where the kernel or the hardware doesn't provide a
+ * counter it is reported as null, and "counters" says why.
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.
+ * If not, see <https://www.gnu.org/licenses/>
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <stdint.h>
+#include <string.h>
+#include <errno.h>
+#include <malloc.h>
+#include <unistd.h>
+#include <sys/ioctl.h>
+#include <sys/resource.h>
+#include <sys/syscall.h>
+#include <linux/perf_event.h>
+
+#include "record_sort.h"
+
+#define MAX_PHASES 16
+#define NCOUNTERS 4
+
+static const struct {
+	const char *name;
+	uint32_t type;
+	uint64_t config;
+} counters[NCOUNTERS] = {
+	{"cycles", PERF_TYPE_HARDWARE, PERF_COUNT_HW_CPU_CYCLES},
+	{"instructions", PERF_TYPE_HARDWARE, PERF_COUNT_HW_INSTRUCTIONS},
+	{"cache_misses", PERF_TYPE_HARDWARE, PERF_COUNT_HW_CACHE_MISSES},
+	{"branch_misses", PERF_TYPE_HARDWARE, PERF_COUNT_HW_BRANCH_MISSES},
+};
+
+typedef struct {
+	const char *name;
+	double wall_ms;
+	size_t heap_bytes;
+	long heap_delta;
+	long peak_rss_kb;
+	long minor_faults, major_faults;
+	int64_t counts[NCOUNTERS];	// -1 where unavailable
+} phase_t;
+
+static struct {
+	char *path;		// where the report goes, NULL when off
+	int fds[NCOUNTERS];
+	char why[128];		// why counters are missing
+	phase_t phases[MAX_PHASES];
+	int nphases;
+	int open;		// a phase is running
+	double start;
+	size_t heap_start;
+	long minflt_start, majflt_start;
+} prof;
+
+static size_t heap_in_use (void)
+{
+#if __GLIBC__ > 2 || (__GLIBC__ == 2 && __GLIBC_MINOR__ >= 33)
+	struct mallinfo2 mi = mallinfo2 ();
+#else
+	struct mallinfo mi = mallinfo ();
+#endif
+
+	return (size_t) mi.uordblks + (size_t) mi.hblkhd;
+}
+
+static int open_counter (uint32_t type, uint64_t config)
+{
+	struct perf_event_attr attr;
+
+	memset (&attr, 0, sizeof (attr));
+	attr.size = sizeof (attr);
+	attr.type = type;
+	attr.config = config;
+	attr.disabled = 1;
+	attr.inherit = 1;
+	attr.exclude_kernel = 1;
+	attr.exclude_hv = 1;
+	attr.read_format = PERF_FORMAT_TOTAL_TIME_ENABLED | PERF_FORMAT_TOTAL_TIME_RUNNING;
+	return syscall (SYS_perf_event_open, &attr, 0, -1, -1, 0);
+}
+
+static int64_t read_counter (int fd)
+/*
+ * The count since the last reset, scaled up if the counter had to
+ * share the hardware with others, or -1
+ */
+{
+	uint64_t v[3];
+
+	if (fd < 0 || read (fd, v, sizeof (v)) != sizeof (v))
+		return -1;
+	if (v[2] > 0 && v[2] < v[1])
+		v[0] = (uint64_t) ((double) v[0]*v[1]/v[2]);
+	return v[0];
+}
+
+static void prof_report (void)
+{
+	FILE *file;
+	phase_t *p;
+	int i, c;
+
+	prof_end ();
+	if ((file = fopen (prof.path, "w")) == NULL)
+	{
+		perror ("record_sort: profile");
+		return;
+	}
+	fprintf (file, "{\"counters\":\"%s\",\"phases\":[", prof.why[0] ? prof.why : "ok");
+	for (i = 0; i < prof.nphases; i++)
+	{
+		p = &prof.phases[i];
+		fprintf (file, "%s\n {\"phase\":\"%s\",\"wall_ms\":%.3f,\"heap_bytes\":%zu,"
+			"\"heap_delta\":%ld,\"peak_rss_kb\":%ld,\"minor_faults\":%ld,"
+			"\"major_faults\":%ld", i ? "," : "", p->name, p->wall_ms,
+			p->heap_bytes, p->heap_delta, p->peak_rss_kb, p->minor_faults,
+			p->major_faults);
+		for (c = 0; c < NCOUNTERS; c++)
+		{
+			if (p->counts[c] < 0)
+				fprintf (file, ",\"%s\":null", counters[c].name);
+			else
+				fprintf (file, ",\"%s\":%lld", counters[c].name, (long long) p->counts[c]);
+		}
+		fputc ('}', file);
+	}
+	fprintf (file, "]}\n");
+	fclose (file);
+	for (c = 0; c < NCOUNTERS; c++)
+		if (prof.fds[c] >= 0)
+			close (prof.fds[c]);
+}
+
+void prof_enable (char *path)
+/*
+ * Turn profiling on, writing the report to path at exit
+ */
+{
+	int c;
+
+	prof.path = path;
+	for (c = 0; c < NCOUNTERS; c++)
+	{
+		if ((prof.fds[c] = open_counter (counters[c].type, counters[c].config)) < 0
+			&& !prof.why[0])
+			snprintf (prof.why, sizeof (prof.why), "%s unavailable: %s",
+				counters[c].name, strerror (errno));
+	}
+	atexit (prof_report);
+}
+
+void prof_begin (const char *phase)
+/*
+ * Start measuring phase, ending any phase still running
+ */
+{
+	struct rusage ru;
+	int c;
+
+	if (prof.path == NULL)
+		return;
+	prof_end ();
+	if (prof.nphases == MAX_PHASES)
+		return;
+	prof.phases[prof.nphases].name = phase;
+	getrusage (RUSAGE_SELF, &ru);
+	prof.minflt_start = ru.ru_minflt;
+	prof.majflt_start = ru.ru_majflt;
+	prof.heap_start = heap_in_use ();
+	for (c = 0; c < NCOUNTERS; c++)
+		if (prof.fds[c] >= 0)
+		{
+			ioctl (prof.fds[c], PERF_EVENT_IOC_RESET, 0);
+			ioctl (prof.fds[c], PERF_EVENT_IOC_ENABLE, 0);
+		}
+	prof.open = 1;
+	prof.start = now_ms ();
+}
+
+void prof_end (void)
+/*
+ * Finish the running phase, if there is one
+ */
+{
+	phase_t *p = &prof.phases[prof.nphases];
+	struct rusage ru;
+	int c;
+
+	if (prof.path == NULL || !prof.open)
+		return;
+	p->wall_ms = now_ms () - prof.start;
+	for (c = 0; c < NCOUNTERS; c++)
+	{
+		if (prof.fds[c] >= 0)
+			ioctl (prof.fds[c], PERF_EVENT_IOC_DISABLE, 0);
+		p->counts[c] = read_counter (prof.fds[c]);
+	}
+	getrusage (RUSAGE_SELF, &ru);
+	p->peak_rss_kb = ru.ru_maxrss;
+	p->minor_faults = ru.ru_minflt - prof.minflt_start;
+	p->major_faults = ru.ru_majflt - prof.majflt_start;
+	p->heap_bytes = heap_in_use ();
+	p->heap_delta = (long) p->heap_bytes - (long) prof.heap_start;
+	prof.nphases++;
+	prof.open = 0;
+}
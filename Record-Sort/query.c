@@ -0,0 +1,291 @@
+/*
+ * Point and range queries for the record_sort example
+ *
+ * A lookup_t holds the records sorted both ways.  Exact ID lookups
+ * search the IDs laid out in Eytzinger (breadth-first tree) order,
+ * which keeps the first levels of every search in the same few cache
+ * lines and lets the next levels be prefetched.  Name prefix lookups
+ * binary search a packed array of 8-byte big-endian name prefixes and
+ * only go to the names themselves to settle ties past the eighth byte.
+ *
+ * Queries can be batched in a file, one per line:
+ *
+ *   id 561         records with ID 561
+ *   prefix Br      records whose name starts with Br
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.
+ * If not, see <https://www.gnu.org/licenses/>
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <stdint.h>
+#include <string.h>
+#include <ctype.h>
+#include <errno.h>
+
+#include "record_sort.h"
+
+static uint64_t key_prefix (const char *name)
+/*
+ * First eight bytes of name, big-endian and zero padded
+ */
+{
+	uint64_t prefix = 0;
+	int i;
+
+	for (i = 0; i < 8 && name[i]; i++)
+		prefix |= (uint64_t) (unsigned char) name[i] << (56 - 8*i);
+	return prefix;
+}
+
+static int fill_eytzinger (lookup_t *lk, int i, int k)
+/*
+ * Lay out by_ID[i..] in the subtree rooted at slot k and return the
+ * next unused position of by_ID
+ */
+{
+	if (k <= lk->size)
+	{
+		i = fill_eytzinger (lk, i, 2*k);
+		lk->eytz[k] = lk->by_ID[i].ID;
+		lk->eytz_pos[k] = i++;
+		i = fill_eytzinger (lk, i, 2*k + 1);
+	}
+	return i;
+}
+
+int build_lookup (lookup_t *lk, int size, record_t records[])
+/*
+ * Build both search structures over a copy of records.  The names are
+ * shared with records, which must outlive the lookup.  Returns 0, or
+ * -1 if memory ran out.
+ */
+{
+	int i;
+
+	memset (lk, 0, sizeof (*lk));
+	lk->size = size;
+	lk->by_name = malloc ((size + 1)*sizeof (record_t));
+	lk->by_ID = malloc ((size + 1)*sizeof (record_t));
+	lk->name_keys = malloc ((size + 1)*sizeof (uint64_t));
+	lk->eytz = malloc ((size + 1)*sizeof (uint32_t));
+	lk->eytz_pos = malloc ((size + 1)*sizeof (int));
+	if (!lk->by_name || !lk->by_ID || !lk->name_keys || !lk->eytz || !lk->eytz_pos)
+	{
+		free_lookup (lk);
+		return -1;
+	}
+
+	memcpy (lk->by_name, records, size*sizeof (record_t));
+	memcpy (lk->by_ID, records, size*sizeof (record_t));
+	sort_name_radix (size, lk->by_name);
+	sort_ID_radix (size, lk->by_ID);
+
+	for (i = 0; i < size; i++)
+		lk->name_keys[i] = key_prefix (lk->by_name[i].name);
+	fill_eytzinger (lk, 0, 1);
+	return 0;
+}
+
+void free_lookup (lookup_t *lk)
+{
+	free (lk->by_name);
+	free (lk->by_ID);
+	free (lk->name_keys);
+	free (lk->eytz);
+	free (lk->eytz_pos);
+	memset (lk, 0, sizeof (*lk));
+}
+
+int lookup_ID (lookup_t *lk, unsigned int ID, int *first)
+/*
+ * Find the records with ID.  Returns how many there are and sets
+ * *first to the position of the first one in lk->by_ID.
+ */
+{
+	int k = 1, n;
+
+	while (k <= lk->size)
+	{
+		__builtin_prefetch (lk->eytz + 16*k);
+		k = 2*k + (lk->eytz[k] < ID);
+	}
+	// Undo the right turns taken after the last left turn
+	k >>= __builtin_ffs (~k);
+	if (k == 0 || lk->eytz[k] != ID)
+		return 0;
+
+	*first = lk->eytz_pos[k];
+	for (n = *first; n < lk->size && lk->by_ID[n].ID == ID; n++)
+		;
+	return n - *first;
+}
+
+int lookup_prefix (lookup_t *lk, const char *prefix, int *first)
+/*
+ * Find the records whose name starts with prefix.  Returns how many
+ * there are and sets *first to the position of the first one in
+ * lk->by_name.
+ */
+{
+	size_t len = strlen (prefix);
+	uint64_t key = key_prefix (prefix);
+	int lo = 0, hi = lk->size, mid, n;
+
+	// Lower bound: the first name not less than prefix
+	while (lo < hi)
+	{
+		mid = (lo + hi)/2;
+		if (lk->name_keys[mid] < key
+			|| (lk->name_keys[mid] == key && len > 8
+				&& strcmp (lk->by_name[mid].name, prefix) < 0))
+			lo = mid + 1;
+		else
+			hi = mid;
+	}
+
+	*first = lo;
+	for (n = lo; n < lk->size && strncmp (lk->by_name[n].name, prefix, len) == 0; n++)
+		;
+	return n - lo;
+}
+
+int parse_ID (const char *arg, unsigned int *ID)
+/*
+ * Parse arg as a record ID: decimal digits only, up to UINT32_MAX.
+ * Returns 0, or -1 if arg isn't one.
+ */
+{
+	unsigned long long n;
+	char *end;
+
+	// strtoull would take a sign or leading blanks, so insist on a digit
+	if (!isdigit ((unsigned char) arg[0]))
+		return -1;
+	errno = 0;
+	n = strtoull (arg, &end, 10);
+	if (*end != '\0' || errno == ERANGE || n > UINT32_MAX)
+		return -1;
+	*ID = n;
+	return 0;
+}
+
+int run_query (lookup_t *lk, const char *kind, const char *arg, writer_t *w)
+/*
+ * Answer one query ("id" or "prefix") by writing the matching records.
+ * Returns the number of matches, -1 for a query that isn't known or
+ * -2 for an ID that parse_ID() doesn't accept.
+ */
+{
+	int i, first = 0, n;
+	unsigned int ID;
+	record_t *hits;
+
+	if (strcmp (kind, "id") == 0)
+	{
+		if (parse_ID (arg, &ID))
+			return -2;
+		n = lookup_ID (lk, ID, &first);
+		hits = lk->by_ID;
+	}
+	else if (strcmp (kind, "prefix") == 0)
+	{
+		n = lookup_prefix (lk, arg, &first);
+		hits = lk->by_name;
+	}
+	else
+		return -1;
+
+	if (w != NULL)
+		for (i = first; i < first + n; i++)
+			put_record (w, hits[i].name, hits[i].ID);
+	return n;
+}
+
+int query_file (lookup_t *lk, char *filename, writer_t *w)
+/*
+ * Run every query in filename and report the lookup rate on stderr.
+ * The queries are read up front so the rate reflects the searches and
+ * output formatting, not the parsing of the query file.  Only the
+ * lookups actually run count towards the rate.  Returns 0, or -1 if
+ * the file can't be read or memory runs out before any query is run.
+ */
+{
+	FILE *file;
+	char *line = NULL, *kind, *arg;
+	size_t cap = 0;
+	char **queries = NULL, **grown;
+	int i, nq = 0, qcap = 0, hits = 0, lookups = 0, n, failed = 0;
+	double start, ms;
+
+	if ((file = fopen (filename, "r")) == NULL)
+		return -1;
+	while (getline (&line, &cap, file) >= 0)
+	{
+		if (nq == qcap)
+		{
+			if ((grown = realloc (queries, (qcap ? 2*qcap : 1024)*sizeof (char *))) == NULL)
+			{
+				failed = 1;
+				break;
+			}
+			queries = grown;
+			qcap = qcap ? 2*qcap : 1024;
+		}
+		if ((queries[nq] = strdup (line)) == NULL)
+		{
+			failed = 1;
+			break;
+		}
+		nq++;
+	}
+	free (line);
+	fclose (file);
+	if (failed)
+	{
+		// A partial list would report a rate for queries it never ran
+		for (i = 0; i < nq; i++)
+			free (queries[i]);
+		free (queries);
+		return -1;
+	}
+
+	start = now_ms ();
+	for (i = 0; i < nq; i++)
+	{
+		kind = strtok (queries[i], " \t\n");
+		arg = strtok (NULL, " \t\n");
+		if (kind == NULL || arg == NULL)
+			continue;
+		if ((n = run_query (lk, kind, arg, w)) == -1)
+			fprintf (stderr, "record_sort: unknown query %s\n", kind);
+		else if (n == -2)
+			fprintf (stderr, "record_sort: bad id %s\n", arg);
+		else
+		{
+			hits += n;
+			lookups++;
+		}
+	}
+	flush_writer (w);
+	ms = now_ms () - start;
+	fprintf (stderr, "%d lookups, %d records found in %.3f ms (%.0f lookups/s)\n",
+		lookups, hits, ms, ms > 0 ? lookups/(ms/1e3) : 0.0);
+
+	for (i = 0; i < nq; i++)
+		free (queries[i]);
+	free (queries);
+	return 0;
+}
@@ -0,0 +1,294 @@
+/*
+ * Radix sorts for the record_sort example
+ *
+ * sort_name_radix() is a most-significant-digit radix sort on the name
+ * bytes.  It orders names exactly as strcmp does and is stable, so
+ * records with equal names keep their input order.  It works on compact
+ * sort entries carrying eight name bytes inline, so most levels never
+ * touch the names themselves; only groups of names that agree on all
+ * eight bytes go back to the names, for the next eight.
+ *
+ * sort_ID_radix() is a least-significant-digit radix sort on the 32-bit
+ * IDs, one byte per pass, and is stable as well.
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.
+ * If not, see <https://www.gnu.org/licenses/>
+ */
+
+#include <stdlib.h>
+#include <stdint.h>
+#include <string.h>
+
+#include "record_sort.h"
+
+/*
+ * Buckets smaller than this are finished with insertion sort
+ */
+#define RADIX_CUTOFF 32
+
+/*
+ * Compact sort entry, 12 bytes.  prefix holds the first eight name
+ * bytes big-endian and zero padded, so comparing prefixes as integers
+ * orders them as strcmp would.
+ */
+typedef struct {
+	uint64_t prefix;
+	uint32_t idx;		// position of the record in the input array
+} __attribute__ ((packed)) sort_entry_t;
+
+typedef struct {
+	record_t *records;	// input, indexed by sort_entry_t.idx
+	sort_entry_t *base;	// the entries being sorted
+	sort_entry_t *tmp;	// scatter space
+	unsigned char *key;	// digit cache, one byte per entry
+} compact_t;
+
+static void insertion_name (record_t a[], int n, size_t depth)
+/*
+ * Stable insertion sort on names that are known to agree on their
+ * first depth bytes
+ */
+{
+	int i, j;
+
+	for (i = 1; i < n; i++)
+	{
+		record_t temp = a[i];
+		for (j = i; j > 0 && strcmp (a[j - 1].name + depth, temp.name + depth) > 0; j--)
+			a[j] = a[j - 1];
+		if (i != j)
+			a[j] = temp;
+	}
+}
+
+static void insertion_ID (record_t a[], int n)
+/*
+ * Stable insertion sort on IDs for inputs too small to radix sort
+ */
+{
+	int i, j;
+
+	for (i = 1; i < n; i++)
+	{
+		record_t temp = a[i];
+		for (j = i; j > 0 && a[j - 1].ID > temp.ID; j--)
+			a[j] = a[j - 1];
+		if (i != j)
+			a[j] = temp;
+	}
+}
+
+static uint64_t name_prefix (const char *name)
+{
+	uint64_t prefix = 0;
+	int i;
+
+	for (i = 0; i < 8 && name[i]; i++)
+		prefix |= (uint64_t) (unsigned char) name[i] << (56 - 8*i);
+	return prefix;
+}
+
+static int entry_less (const sort_entry_t *a, const sort_entry_t *b,
+	record_t records[], size_t depth)
+/*
+ * Order two entries whose prefixes hold the name bytes from depth on
+ */
+{
+	if (a->prefix != b->prefix)
+		return a->prefix < b->prefix;
+	// A zero low byte means both names ended inside the prefix
+	if ((a->prefix & 0xff) == 0)
+		return 0;
+	return strcmp (records[a->idx].name + depth + 8,
+		records[b->idx].name + depth + 8) < 0;
+}
+
+static void msd_entries (compact_t *c, sort_entry_t a[], int n, int byte,
+	size_t depth)
+/*
+ * Sort a[0..n-1] on the prefix bytes from byte on.  The prefixes hold
+ * the name bytes from depth on; when a bucket agrees on all eight, the
+ * next eight bytes are loaded from the names and sorting carries on.
+ */
+{
+	int i, j, big, count[256], start[256];
+
+	while (n >= RADIX_CUTOFF)
+	{
+		int shift;
+
+		if (byte == 8)
+		{
+			depth += 8;
+			for (i = 0; i < n; i++)
+				a[i].prefix = name_prefix (c->records[a[i].idx].name + depth);
+			byte = 0;
+		}
+		shift = 56 - 8*byte;
+
+		memset (count, 0, sizeof (count));
+		for (i = 0; i < n; i++)
+			count[c->key[i] = a[i].prefix >> shift & 0xff]++;
+
+		// Every entry shares this byte: move on without scattering
+		if (count[c->key[0]] == n)
+		{
+			if (c->key[0] == 0)
+				return;
+			byte++;
+			continue;
+		}
+
+		start[0] = 0;
+		for (i = 1; i < 256; i++)
+			start[i] = start[i - 1] + count[i - 1];
+		for (i = 0; i < n; i++)
+			c->tmp[start[c->key[i]]++] = a[i];
+		memcpy (a, c->tmp, n*sizeof (sort_entry_t));
+
+		// Bucket 0 holds names that ended here; they are already equal.
+		// Recurse on all but the largest bucket and carry on with that
+		// one here, so the stack only grows with each halving of n.
+		big = 0;
+		for (i = 1; i < 256; i++)
+			if (count[i] > count[big])
+				big = i;
+		for (i = 1; i < 256; i++)
+			if (i != big && count[i] > 1)
+				msd_entries (c, a + start[i] - count[i], count[i], byte + 1, depth);
+		if (big == 0)
+			return;
+		a += start[big] - count[big];
+		n = count[big];
+		byte++;
+	}
+
+	for (i = 1; i < n; i++)
+	{
+		sort_entry_t temp = a[i];
+		for (j = i; j > 0 && entry_less (&temp, &a[j - 1], c->records, depth); j--)
+			a[j] = a[j - 1];
+		if (i != j)
+			a[j] = temp;
+	}
+}
+
+void sort_name_radix (int size, record_t records[])
+/*
+ * Sort records in ascending order by name using MSD radix sort.  The
+ * new order is worked out on compact entries and applied to the
+ * records in one pass at the end.
+ */
+{
+	compact_t c;
+	record_t *out;
+	int i;
+
+	if (size < RADIX_CUTOFF)
+	{
+		insertion_name (records, size, 0);
+		return;
+	}
+	c.records = records;
+	c.base = malloc (size*sizeof (sort_entry_t));
+	// The scatter space doubles as room for the reordered records
+	c.tmp = malloc (size*(sizeof (record_t) > sizeof (sort_entry_t) ?
+		sizeof (record_t) : sizeof (sort_entry_t)));
+	c.key = malloc (size);
+	if (c.base == NULL || c.tmp == NULL || c.key == NULL)
+	{
+		free (c.base);
+		free (c.tmp);
+		free (c.key);
+		// Stable like the radix sort while the merge sort can get its
+		// buffer; if not, it heapsorts in place
+		key_sorter (SORT_NAME, ALGO_MERGE) (size, records);
+		return;
+	}
+
+	for (i = 0; i < size; i++)
+	{
+		c.base[i].prefix = name_prefix (records[i].name);
+		c.base[i].idx = i;
+	}
+	msd_entries (&c, c.base, size, 0, 0);
+
+	// The scatter space is free again
+	out = (record_t *) c.tmp;
+	for (i = 0; i < size; i++)
+		out[i] = records[c.base[i].idx];
+	memcpy (records, out, size*sizeof (record_t));
+
+	free (c.base);
+	free (c.tmp);
+	free (c.key);
+}
+
+void sort_ID_radix (int size, record_t records[])
+/*
+ * Sort records in ascending order by ID using LSD radix sort.  All four
+ * byte histograms come from a single scan, and a pass whose byte is the
+ * same for every key is skipped.
+ */
+{
+	int i, pass;
+	int count[4][256];
+	record_t *src = records, *dst, *tmp;
+
+	if (size < RADIX_CUTOFF)
+	{
+		insertion_ID (records, size);
+		return;
+	}
+	if ((tmp = malloc (size*sizeof (record_t))) == NULL)
+	{
+		// Stable like the radix sort while the merge sort can get its
+		// buffer; if not, it heapsorts in place
+		key_sorter (SORT_ID, ALGO_MERGE) (size, records);
+		return;
+	}
+
+	memset (count, 0, sizeof (count));
+	for (i = 0; i < size; i++)
+	{
+		unsigned int id = records[i].ID;
+		count[0][id & 0xff]++;
+		count[1][(id >> 8) & 0xff]++;
+		count[2][(id >> 16) & 0xff]++;
+		count[3][id >> 24]++;
+	}
+
+	dst = tmp;
+	for (pass = 0; pass < 4; pass++)
+	{
+		int shift = pass*8, sum = 0, c;
+
+		if (count[pass][(src[0].ID >> shift) & 0xff] == size)
+			continue;
+		for (i = 0; i < 256; i++)
+		{
+			c = count[pass][i];
+			count[pass][i] = sum;
+			sum += c;
+		}
+		for (i = 0; i < size; i++)
+			dst[count[pass][(src[i].ID >> shift) & 0xff]++] = src[i];
+		dst = src;
+		src = src == records ? tmp : records;
+	}
+
+	if (src != records)
+		memcpy (records, src, size*sizeof (record_t));
+	free (tmp);
+}
@@ -0,0 +1,169 @@
+/*
+ * record_bench.c
+ *
+ * Benchmark driver for record_sort.
+ *
+ * Loads each datafile, sorts it and writes it out, the same way
+ * record_sort does, and times the three phases separately.  Each run is
+ * reported on stdout as one JSON object per line, so results from
+ * different commits can be collected in one file and compared:
+ *
+ *   {"label":"ca1f6a6","file":"d1M.txt","records":1000000,"loader":"read",
+ *    "algo":"radix","key":"name","jobs":1,"run":0,"read_ms":180.2,
+ *    "collate":"bytes","collate_ms":0.0,"sort_ms":95.1,"write_ms":60.3,
+ *    "total_ms":335.6,"sorted":true}
+ *
+ * Usage: record_bench [-m] [-a algo] [-k key] [-c MODE] [-j N] [-r RUNS]
+ *                     [-l LABEL] [-o FILE] datafile...
+ *
+ *   -m         map the datafiles instead of reading them
+ *   -a algo    radix (default), shell, merge or adaptive
+ *   -k key     sort key as for record_sort: 1, 2, name,id:desc, ...
+ *   -c MODE    collation as for record_sort --collate; building the keys
+ *              is timed as collate_ms, apart from the sort
+ *   -j N       sort with N threads
+ *   -r RUNS    runs per datafile (3)
+ *   -l LABEL   label for the results, e.g. the commit being measured
+ *   -o FILE    write the sorted records to FILE (default /dev/null)
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.
+ * If not, see <https://www.gnu.org/licenses/>
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+#include <fcntl.h>
+
+#include "record_sort.h"
+
+#define USAGE "Usage: %s [-m] [-a algo] [-k key] [-c MODE] [-j N] [-r RUNS] [-l LABEL] " \
+	"[-o FILE] datafile...\n"
+
+static int is_sorted (int size, record_t records[], int key)
+{
+	int i;
+
+	for (i = 1; i < size; i++)
+		if (record_less (&records[i], &records[i - 1], key))
+			return 0;
+	return 1;
+}
+
+int main (int argc, char **argv)
+{
+	int opt, f, run, size, key = SORT_NAME, algo = ALGO_RADIX;
+	int jobs = 1, runs = 3, out, sorted, result = 0, collate;
+	int (*load) (char *, int *, record_t **) = read_file;
+	char *label = "", *key_arg = "name", *algo_arg = "radix", *collate_arg = "bytes";
+	char *output = "/dev/null";
+	double start, read_ms, collate_ms, sort_ms, write_ms;
+	sort_fn sorter;
+	record_t *records;
+
+	while ((opt = getopt (argc, argv, "ma:k:c:j:r:l:o:")) != -1)
+	{
+		switch (opt)
+		{
+			case 'm': load = map_file;
+			break;
+			case 'a': algo_arg = optarg;
+			break;
+			case 'k': key_arg = optarg;
+			break;
+			case 'c': collate_arg = optarg;
+			break;
+			case 'j': jobs = atoi (optarg);
+			break;
+			case 'r': runs = atoi (optarg);
+			break;
+			case 'l': label = optarg;
+			break;
+			case 'o': output = optarg;
+			break;
+			default:
+			fprintf (stderr, USAGE, argv[0]);
+			exit (2);
+		}
+	}
+	if (optind >= argc)
+	{
+		fprintf (stderr, USAGE, argv[0]);
+		exit (2);
+	}
+	if ((algo = parse_algo (algo_arg)) < 0
+		|| (sorter = choose_sorter (key = parse_key (key_arg), algo)) == NULL
+		|| (collate = parse_collation (collate_arg)) < 0)
+	{
+		fprintf (stderr, "Invalid sort algorithm, key or collation\n");
+		exit (2);
+	}
+
+	for (f = optind; f < argc; f++)
+	{
+		for (run = 0; run < runs; run++)
+		{
+			start = now_ms ();
+			if (load (argv[f], &size, &records))
+			{
+				fprintf (stderr, "Couldn't open file %s\n", argv[f]);
+				result = 1;
+				break;
+			}
+			read_ms = now_ms () - start;
+
+			start = now_ms ();
+			if (collate_names (size, records, collate, 0))
+			{
+				fprintf (stderr, "Couldn't build collation keys\n");
+				exit (1);
+			}
+			collate_ms = now_ms () - start;
+
+			start = now_ms ();
+			par_sort (size, records, sorter, key, jobs, 0);
+			sort_ms = now_ms () - start;
+			sorted = is_sorted (size, records, key);
+			restore_names (size, records);
+
+			if ((out = open (output, O_WRONLY | O_CREAT | O_TRUNC, 0644)) < 0)
+			{
+				fprintf (stderr, "Couldn't create file %s\n", output);
+				exit (1);
+			}
+			start = now_ms ();
+			if (write_records (out, size, records) || close (out))
+			{
+				perror ("record_bench: output");
+				result = 1;
+			}
+			write_ms = now_ms () - start;
+
+			return_records (size, records);
+			printf ("{\"label\":\"%s\",\"file\":\"%s\",\"records\":%d,"
+				"\"loader\":\"%s\",\"algo\":\"%s\",\"key\":\"%s\",\"jobs\":%d,"
+				"\"run\":%d,\"read_ms\":%.3f,\"collate\":\"%s\",\"collate_ms\":%.3f,"
+				"\"sort_ms\":%.3f,\"write_ms\":%.3f,\"total_ms\":%.3f,\"sorted\":%s}\n",
+				label, argv[f], size, load == map_file ? "map" : "read",
+				algo_arg, key_arg, jobs, run, read_ms, collate_arg, collate_ms,
+				sort_ms, write_ms, read_ms + collate_ms + sort_ms + write_ms,
+				sorted ? "true" : "false");
+			fflush (stdout);
+			if (!sorted)
+				result = 1;
+		}
+	}
+	return result;
+}
@@ -21,37 +21,372 @@
 
 #include <stdio.h>
 #include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+#include <getopt.h>
+#include <fcntl.h>
 #include "record_sort.h"
 
+#define USAGE "Usage: %s [-m] [-v] [-a algo] [-j N] [-o FILE] [--mem-limit SIZE] " \
+    "[--convert OUT] [--index] [--top K] [--group | --dedup] [--profile FILE] " \
+    "[--collate MODE] [--query FILE | --id N | --prefix P] datafile [sort]\n"
+
+static struct option long_options[] = {
+    {"mem-limit", required_argument, NULL, 'M'},
+    {"convert", required_argument, NULL, 'C'},
+    {"index", no_argument, NULL, 'I'},
+    {"top", required_argument, NULL, 'T'},
+    {"group", no_argument, NULL, 'G'},
+    {"dedup", no_argument, NULL, 'D'},
+    {"profile", required_argument, NULL, 'P'},
+    {"collate", required_argument, NULL, 'L'},
+    {"query", required_argument, NULL, 'Q'},
+    {"id", required_argument, NULL, 'i'},
+    {"prefix", required_argument, NULL, 'p'},
+    {NULL, 0, NULL, 0}
+};
+
+static size_t parse_size (char *arg)
+/*
+ * Byte count with an optional K, M or G suffix
+ */
+{
+    char *end;
+    size_t n = strtoull (arg, &end, 10);
+
+    switch (*end)
+    {
+        case 'G': case 'g': n <<= 10;
+        /* fall through */
+        case 'M': case 'm': n <<= 10;
+        /* fall through */
+        case 'K': case 'k': n <<= 10;
+    }
+    return n;
+}
+
+/*
+ * Usage: record_sort [-m] [-v] [-a algo] [-j N] [-o FILE] [--mem-limit SIZE]
+ *                    [--convert OUT] [--index] [--top K] [--group | --dedup]
+ *                    [--profile FILE] [--collate MODE]
+ *                    [--query FILE | --id N | --prefix P] datafile [sort]
+ *
+ *   sort              1 = by name (default), 2 = by ID, or a list of
+ *                     fields such as name,id:desc
+ *   -m                map the datafile instead of reading it into name_arena
+ *   -v                report load statistics and sort time on stderr
+ *   -a algo           radix (default), shell, merge or adaptive
+ *   -j N              sort with N threads (1 to 64), and with -m parse
+ *                     with them
+ *   -o FILE           write the sorted records to FILE instead of stdout
+ *   --mem-limit SIZE  external merge sort keeping memory under SIZE bytes
+ *                     (K, M and G suffixes allowed)
+ *   --convert OUT     write the datafile to OUT as a binary record file
+ *                     instead of sorting it
+ *   --index           keep sorted indexes next to the datafile and only
+ *                     sort what was appended since the last run
+ *   --top K           write only the first K sorted records, keeping
+ *                     K records in memory however long the datafile is
+ *   --group           report the IDs that occur more than once, and
+ *                     their names if they conflict, instead of sorting
+ *   --dedup           keep only the first record for each ID
+ *   --profile FILE    write wall time, heap use, peak RSS and hardware
+ *                     counters for each phase to FILE as JSON
+ *   --collate MODE    order names by bytes (default), nocase, ignoring
+ *                     ASCII case, or locale, as strcoll() does in the
+ *                     LC_COLLATE locale
+ *   --query FILE      answer the "id N" and "prefix P" lookups in FILE
+ *                     instead of sorting, and report lookups per second
+ *   --id N            print the records with ID N
+ *   --prefix P        print the records whose name starts with P
+ *
+ * A binary record file given as the datafile is always mapped with
+ * map_binary().  A datafile of "-" is standard input, which is sorted
+ * by stream_sort() as it arrives.
+ */
 int main (int argc, char **argv)
 {
-    int size, sort = 1;
+    int opt, size, written, sort = SORT_NAME, verbose = 0, jobs = 1;
+    int out = STDOUT_FILENO, indexed = 0, top = 0, algo = ALGO_RADIX;
+    int group = 0, dedup = 0, collate = COLLATE_BYTES;
+    unsigned int id;
+    long n;
+    size_t mem_limit = 0;
+    double start;
+    sort_fn sorter;
+    int (*load) (char *, int *, record_t **) = read_file;
+    char *filename, *convert = NULL, *output = NULL, *end;
+    char *queries = NULL, *query_kind = NULL, *query_arg = NULL;
     record_t *records;
 
-    if (read_file (argv[1], &size, &records))
+    while ((opt = getopt_long (argc, argv, "mva:j:o:", long_options, NULL)) != -1)
+    {
+        switch (opt)
+        {
+            case 'm': load = map_file;
+            break;
+            case 'v': verbose = 1;
+            break;
+            case 'a':
+            if ((algo = parse_algo (optarg)) < 0)
+            {
+                printf ("Unknown sort algorithm %s\n", optarg);
+                exit (2);
+            }
+            break;
+            case 'j':
+            n = strtol (optarg, &end, 10);
+            if (*optarg == '\0' || *end != '\0' || n < 1 || n > MAX_JOBS)
+            {
+                printf ("Thread count must be 1 to %d\n", MAX_JOBS);
+                exit (2);
+            }
+            jobs = n;
+            break;
+            case 'o': output = optarg;
+            break;
+            case 'M': mem_limit = parse_size (optarg);
+            break;
+            case 'C': convert = optarg;
+            break;
+            case 'I': indexed = 1;
+            break;
+            case 'T': top = atoi (optarg);
+            break;
+            case 'G': group = 1;
+            break;
+            case 'D': dedup = 1;
+            break;
+            case 'P': prof_enable (optarg);
+            break;
+            case 'L':
+            if ((collate = parse_collation (optarg)) < 0)
+            {
+                printf ("Unknown collation %s\n", optarg);
+                exit (2);
+            }
+            break;
+            case 'Q': queries = optarg;
+            break;
+            case 'i':
+            if (parse_ID (optarg, &id))
+            {
+                printf ("Invalid ID %s\n", optarg);
+                exit (2);
+            }
+            query_kind = "id";
+            query_arg = optarg;
+            break;
+            case 'p': query_kind = "prefix";
+            query_arg = optarg;
+            break;
+            default:
+            printf (USAGE, argv[0]);
+            exit (2);
+        }
+    }
+    if (optind >= argc)
     {
-        printf ("Couldn't open file %s\n", argv[1]);
+        printf (USAGE, argv[0]);
+        exit (2);
+    }
+    filename = argv[optind];
+    if (argc > optind + 1)
+        sort = parse_key (argv[optind + 1]);
+    
+    if ((sorter = choose_sorter (sort, algo)) == NULL)
+    {
+        printf ("Invalid sort argument\n");
+        exit (2);
+    }
+    
+    if (output && !convert
+        && (out = open (output, O_WRONLY | O_CREAT | O_TRUNC, 0644)) < 0)
+    {
+        printf ("Couldn't create file %s\n", output);
         exit (1);
     }
     
-    if (argc > 2)
-        sort = atoi (argv[2]);
+    // Standard input can only be read, and a plain sort of it is pipelined
+    if (strcmp (filename, "-") == 0)
+    {
+        load = read_file;
+        indexed = mem_limit = 0;
+        if (!convert && !group && !dedup && !top && !queries && !query_kind
+            && !collate)
+        {
+            fflush (stdout);
+            prof_begin ("stream sort");
+            if (stream_sort (out, sorter, sort, verbose) || (output && close (out)))
+            {
+                printf ("Couldn't sort standard input\n");
+                exit (1);
+            }
+            return 0;
+        }
+    }
     
-    switch (sort)
+    if (is_binary_file (filename))
     {
-        case 1: sort_name (size, records);
-        break;
-        case 2: sort_ID (size, records);
-        break;
-        default:
-        printf ("Invalid sort argument\n");
+        load = map_binary;
+        mem_limit = 0;
+    }
+    
+    // Grouping and dedup need every record in memory
+    if (group || dedup)
+        top = indexed = mem_limit = 0;
+    
+    // So do collation keys; the top K are then cut from the full sort
+    if (collate)
+        indexed = mem_limit = 0;
+    
+    if (top > 0 && !convert && !queries && !query_kind && !collate)
+    {
+        fflush (stdout);
+        prof_begin ("top");
+        if (top_sort (filename, load == map_binary, out, sort, top, verbose)
+            || (output && close (out)))
+        {
+            printf ("Couldn't sort file %s\n", filename);
+            exit (1);
+        }
+        return 0;
+    }
+    
+    if (indexed && load != map_binary && !convert
+        && (sort == SORT_NAME || sort == SORT_ID))
+    {
+        fflush (stdout);
+        prof_begin ("index sort");
+        if (index_sort (filename, out, sort, jobs, verbose)
+            || (output && close (out)))
+        {
+            printf ("Couldn't index file %s\n", filename);
+            exit (1);
+        }
+        return 0;
+    }
+    
+    if (mem_limit && !convert)
+    {
+        prof_begin ("external sort");
+        if (ext_sort (filename, out, sorter, sort, mem_limit, jobs, verbose))
+        {
+            printf ("Couldn't sort file %s\n", filename);
+            exit (1);
+        }
+        return 0;
+    }
+    
+    prof_begin ("load");
+    start = now_ms ();
+    if (load == map_file && jobs > 1)
+        opt = par_map_file (filename, jobs, &size, &records);
+    else
+        opt = load (filename, &size, &records);
+    if (opt)
+    {
+        printf ("Couldn't open file %s\n", filename);
+        exit (1);
+    }
+    if (verbose)
+        fprintf (stderr, "%d records loaded in %.3f ms, names %zu bytes in %zu chunks (peak %zu)\n",
+            size, now_ms () - start, name_arena.used, name_arena.chunks, name_arena.peak);
+    if (convert)
+    {
+        prof_begin ("convert");
+        if (write_binary (convert, size, records))
+        {
+            printf ("Couldn't write binary file %s\n", convert);
+            return_records (size, records);
+            exit (1);
+        }
         return_records (size, records);
-        exit (2);
+        return 0;
     }
+    if (group)
+    {
+        fflush (stdout);
+        prof_begin ("group");
+        opt = group_report (size, records, out) || (output && close (out));
+        return_records (size, records);
+        if (opt)
+        {
+            perror ("record_sort: group");
+            exit (1);
+        }
+        return 0;
+    }
+    if (dedup)
+        prof_begin ("dedup");
+    if (dedup && (size = dedup_records (size, records, verbose)) < 0)
+    {
+        printf ("Couldn't group records\n");
+        exit (1);
+    }
+    if (queries || query_kind)
+    {
+        lookup_t lk;
+        writer_t w;
+        
+        fflush (stdout);
+        prof_begin ("lookup build");
+        start = now_ms ();
+        if (build_lookup (&lk, size, records) || open_writer (&w, out))
+        {
+            printf ("Couldn't index records\n");
+            exit (1);
+        }
+        if (verbose)
+            fprintf (stderr, "lookup structures built in %.3f ms\n", now_ms () - start);
+        prof_begin ("queries");
+        if (queries && query_file (&lk, queries, &w))
+        {
+            printf ("Couldn't read queries from %s\n", queries);
+            exit (1);
+        }
+        if (query_kind)
+            run_query (&lk, query_kind, query_arg, &w);
+        opt = close_writer (&w);
+        free_lookup (&lk);
+        return_records (size, records);
+        return opt ? 1 : 0;
+    }
+    
+    if (collate)
+        prof_begin ("collation keys");
+    if (collate && collate_names (size, records, collate, verbose))
+    {
+        printf ("Couldn't build collation keys\n");
+        exit (1);
+    }
+    prof_begin ("sort");
+    start = now_ms ();
+    if (par_sort (size, records, sorter, sort, jobs, verbose))
+    {
+        printf ("Couldn't sort with %d threads\n", jobs);
+        exit (1);
+    }
+    if (verbose)
+        fprintf (stderr, "sorted in %.3f ms\n", now_ms () - start);
+    restore_names (size, records);
     
-    write_sorted (size, records);
+    prof_begin ("write");
+    start = now_ms ();
+    written = top > 0 && top < size ? top : size;
+    if (output)
+        opt = write_records (out, written, records) || close (out);
+    else
+        opt = write_sorted (written, records);
+    if (verbose)
+        fprintf (stderr, "written in %.3f ms\n", now_ms () - start);
+    prof_end ();
     return_records (size, records);
+    if (opt)
+    {
+        perror ("record_sort: output");
+        exit (1);
+    }
     
     return 0;
 }
-
@@ -22,6 +22,10 @@
 #ifndef RECORD_SORT_H_
 #define RECORD_SORT_H_
 
+#include <stdio.h>
+#include <stdint.h>
+#include <string.h>
+
 /*
  * record type to sort on
  */
@@ -30,13 +34,189 @@ typedef struct {
 	unsigned int ID;
 } record_t;
 
+/*
+ * Sort keys.  A key is a list of up to two fields, the first in the low
+ * bits, each SORT_NAME or SORT_ID with SORT_DESC or'ed in to reverse it.
+ * 1 and 2 are the keys given on the command line by number.
+ */
+#define SORT_NAME	1
+#define SORT_ID		2
+#define SORT_DESC	4
+#define SORT_FIELD_BITS	4
+#define SORT_FIELD_MASK	((1 << SORT_FIELD_BITS) - 1)
+#define SORT_KEY2(first, second)	((first) | (second) << SORT_FIELD_BITS)
+
+typedef void (*sort_fn) (int size, record_t records[]);
+
+/*
+ * Sort algorithms, as given with -a
+ */
+#define ALGO_RADIX	0
+#define ALGO_SHELL	1
+#define ALGO_MERGE	2
+#define ALGO_ADAPTIVE	3
+
+/*
+ * Most threads par_sort() and par_scan() will use, and so the largest
+ * -j accepted
+ */
+#define MAX_JOBS	64
+
+/*
+ * Name collations, as given with --collate
+ */
+#define COLLATE_BYTES	0
+#define COLLATE_NOCASE	1
+#define COLLATE_LOCALE	2
+
+static inline int field_cmp (const record_t *a, const record_t *b, int field)
+{
+	int c;
+
+	if ((field & ~SORT_DESC) == SORT_ID)
+		c = (a->ID > b->ID) - (a->ID < b->ID);
+	else
+		c = strcmp (a->name, b->name);
+	return field & SORT_DESC ? -c : c;
+}
+
+static inline int record_cmp (const record_t *a, const record_t *b, int key)
+/*
+ * <0, 0 or >0 as a sorts before, with or after b on key.  With key a
+ * constant this folds down to the comparisons for its fields.
+ */
+{
+	int c = field_cmp (a, b, key & SORT_FIELD_MASK);
+
+	if (c == 0 && (key >> SORT_FIELD_BITS) != 0)
+		c = field_cmp (a, b, key >> SORT_FIELD_BITS);
+	return c;
+}
+
+static inline int record_less (const record_t *a, const record_t *b, int key)
+/*
+ * Strict ordering of two records on key
+ */
+{
+	if (key == SORT_ID)
+		return a->ID < b->ID;
+	if (key == SORT_NAME)
+		return strcmp (a->name, b->name) < 0;
+	return record_cmp (a, b, key) < 0;
+}
+
+/*
+ * Bump allocator that holds the names loaded by read_file()
+ */
+#define ARENA_CHUNK (1 << 20)
+
+typedef struct arena_chunk arena_chunk_t;
+
+typedef struct {
+	arena_chunk_t *head;
+	size_t chunks;		// chunks currently held
+	size_t used;		// bytes handed out
+	size_t reserved;	// bytes in chunks
+	size_t peak;		// high water mark of used
+} arena_t;
+
+extern arena_t name_arena;
+
+/*
+ * Streaming record reader, one line at a time
+ */
+typedef struct {
+	FILE *file;
+	char *line;
+	size_t cap;
+	char *pos, *end;
+	char *next;		// following line, when a record spans two
+	size_t next_cap;
+} reader_t;
+
+/*
+ * Buffered output writer used by write_sorted()
+ */
+#define OUT_BUFFER (1 << 20)
+
+typedef struct {
+	int fd;
+	char *buf;
+	size_t len;
+	int error;		// errno of the first failed write
+} writer_t;
+
+/*
+ * Search structures over a loaded record set, see query.c
+ */
+typedef struct {
+	int size;
+	record_t *by_name;	// sorted by name
+	record_t *by_ID;	// sorted by ID
+	uint64_t *name_keys;	// first 8 bytes of each by_name name, big-endian
+	uint32_t *eytz;		// by_ID IDs in Eytzinger order, from slot 1
+	int *eytz_pos;		// position in by_ID of each Eytzinger slot
+} lookup_t;
+
 /*
  * Function prototypes
  */
 int read_file (char *filename, int *size, record_t *records[]);
+int map_file (char *filename, int *size, record_t *records[]);
+char *map_text (char *filename, size_t *len);
+int scan_span (char *p, char *end, int *size, record_t *records[], char **stop);
+int par_scan (char *p, char *end, int jobs, int *size, record_t *records[],
+	char **stop);
+int par_map_file (char *filename, int jobs, int *size, record_t *records[]);
+void keep_mapping (char *base, size_t span);
+int release_mapping (void);
+int is_binary_file (char *filename);
+int write_binary (char *filename, int size, record_t records[]);
+int map_binary (char *filename, int *size, record_t *records[]);
+char *scan_record (char *p, char *end, record_t *rec);
+void open_reader (reader_t *rd, FILE *file);
+int next_record (reader_t *rd, record_t *rec);
+void close_reader (reader_t *rd);
+void *arena_alloc (arena_t *arena, size_t len);
+char *arena_strndup (arena_t *arena, const char *s, size_t len);
+void arena_release (arena_t *arena);
 int write_sorted (int size, record_t records[]);
+int write_records (int fd, int size, record_t records[]);
+int open_writer (writer_t *w, int fd);
+void put_record (writer_t *w, const char *name, unsigned int ID);
+int flush_writer (writer_t *w);
+int close_writer (writer_t *w);
 void return_records (int size, record_t records[]);
 void sort_name (int size, record_t records[]);
 void sort_ID (int size, record_t records[]);
+void sort_name_radix (int size, record_t records[]);
+void sort_ID_radix (int size, record_t records[]);
+sort_fn key_sorter (int key, int algo);
+int parse_key (const char *arg);
+int parse_algo (const char *arg);
+sort_fn choose_sorter (int key, int algo);
+int par_sort (int size, record_t records[], sort_fn sorter, int key,
+	int jobs, int verbose);
+int ext_sort (char *filename, int out, sort_fn sorter, int key,
+	size_t mem_limit, int jobs, int verbose);
+int parse_collation (const char *arg);
+int collate_names (int size, record_t records[], int mode, int verbose);
+void restore_names (int size, record_t records[]);
+int group_report (int size, record_t records[], int fd);
+int dedup_records (int size, record_t records[], int verbose);
+int stream_sort (int out, sort_fn sorter, int key, int verbose);
+int top_sort (char *filename, int binary, int out, int key, int k, int verbose);
+int index_sort (char *filename, int out, int key, int jobs, int verbose);
+int build_lookup (lookup_t *lk, int size, record_t records[]);
+void free_lookup (lookup_t *lk);
+int lookup_ID (lookup_t *lk, unsigned int ID, int *first);
+int lookup_prefix (lookup_t *lk, const char *prefix, int *first);
+int parse_ID (const char *arg, unsigned int *ID);
+int run_query (lookup_t *lk, const char *kind, const char *arg, writer_t *w);
+int query_file (lookup_t *lk, char *filename, writer_t *w);
+void prof_enable (char *path);
+void prof_begin (const char *phase);
+void prof_end (void);
+double now_ms (void);
 
 #endif /*RECORD_SORT_H_*/
@@ -0,0 +1,467 @@
+/*
+ * sort_core.h
+ *
+ * Generic sort core for the record_sort example.  Each macro expands to
+ * a complete sort function for one key, given as a compile-time
+ * constant, so record_cmp() is inlined and folded down to the plain
+ * strcmp or integer comparisons for that key.  No comparison goes
+ * through a function pointer.
+ *
+ *   DEFINE_SHELL_SORT (fn, KEY)   the original shell sort, not stable
+ *   DEFINE_MERGE_SORT (fn, KEY)   bottom-up merge sort, stable unless
+ *                                 its buffer can't be allocated
+ *   DEFINE_RUN_SORT (fn, KEY)     adaptive natural merge sort, stable
+ *                                 unless its buffer can't be allocated
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.
+ * If not, see <https://www.gnu.org/licenses/>
+ */
+
+#ifndef SORT_CORE_H_
+#define SORT_CORE_H_
+
+#include <stdlib.h>
+#include <string.h>
+
+#include "record_sort.h"
+
+/*
+ * Runs shorter than this are insertion sorted before merging
+ */
+#define MERGE_RUN 32
+
+/*
+ * In-place heapsort, the fallback when a stable sort can't allocate its
+ * scratch space.  It isn't stable, but it needs no memory and stays
+ * O(n log n), where insertion sort over the whole array would be
+ * quadratic.
+ */
+#define DEFINE_HEAP_SORT(fn, KEY)					\
+static void fn##_sift (record_t a[], int i, int n)			\
+{									\
+	record_t temp = a[i];						\
+	int child;							\
+									\
+	while ((child = 2*i + 1) < n)					\
+	{								\
+		if (child + 1 < n && record_less (&a[child], &a[child + 1], KEY)) \
+			child++;					\
+		if (!record_less (&temp, &a[child], KEY))		\
+			break;						\
+		a[i] = a[child];					\
+		i = child;						\
+	}								\
+	a[i] = temp;							\
+}									\
+									\
+static void fn##_heap (record_t a[], int n)				\
+{									\
+	record_t temp;							\
+	int i;								\
+									\
+	for (i = n/2 - 1; i >= 0; i--)					\
+		fn##_sift (a, i, n);					\
+	for (i = n - 1; i > 0; i--)					\
+	{								\
+		temp = a[0];						\
+		a[0] = a[i];						\
+		a[i] = temp;						\
+		fn##_sift (a, 0, i);					\
+	}								\
+}
+
+#define DEFINE_SHELL_SORT(fn, KEY)					\
+void fn (int size, record_t records[])					\
+{									\
+	int i, j;							\
+	int h = 1;							\
+									\
+	do								\
+		h = h*3 + 1;						\
+	while (h <= size);						\
+									\
+	do								\
+	{								\
+		h /= 3;							\
+		for (i = h; i < size; i++)				\
+		{							\
+			record_t temp = records[i];			\
+			for (j = i; j >= h				\
+				&& record_less (&temp, &records[j - h], KEY); j -= h) \
+				records[j] = records[j - h];		\
+			if (i != j)					\
+				records[j] = temp;			\
+		}							\
+	}								\
+	while (h != 1);							\
+}
+
+#define DEFINE_MERGE_SORT(fn, KEY)					\
+DEFINE_HEAP_SORT (fn, KEY)						\
+									\
+static void fn##_insertion (record_t a[], int n)			\
+{									\
+	int i, j;							\
+									\
+	for (i = 1; i < n; i++)						\
+	{								\
+		record_t temp = a[i];					\
+		for (j = i; j > 0 && record_less (&temp, &a[j - 1], KEY); j--) \
+			a[j] = a[j - 1];				\
+		a[j] = temp;						\
+	}								\
+}									\
+									\
+static void fn##_merge (record_t out[], record_t a[], int n1,		\
+	record_t b[], int n2)						\
+{									\
+	int i = 0, j = 0, k = 0;					\
+									\
+	/* Already in order: nothing to compare */			\
+	if (n1 == 0 || n2 == 0 || !record_less (&b[0], &a[n1 - 1], KEY)) \
+	{								\
+		memcpy (out, a, n1*sizeof (record_t));			\
+		memcpy (out + n1, b, n2*sizeof (record_t));		\
+		return;							\
+	}								\
+	while (i < n1 && j < n2)					\
+		out[k++] = record_less (&b[j], &a[i], KEY) ? b[j++] : a[i++]; \
+	memcpy (out + k, a + i, (n1 - i)*sizeof (record_t));		\
+	memcpy (out + k + n1 - i, b + j, (n2 - j)*sizeof (record_t));	\
+}									\
+									\
+void fn (int size, record_t records[])					\
+{									\
+	record_t *from = records, *to, *swap;				\
+	int i, width;							\
+									\
+	for (i = 0; i < size; i += MERGE_RUN)				\
+		fn##_insertion (records + i,				\
+			size - i < MERGE_RUN ? size - i : MERGE_RUN);	\
+	if (size <= MERGE_RUN)						\
+		return;							\
+	if ((to = malloc (size*sizeof (record_t))) == NULL)		\
+	{								\
+		fn##_heap (records, size);				\
+		return;							\
+	}								\
+									\
+	for (width = MERGE_RUN; width < size; width *= 2)		\
+	{								\
+		for (i = 0; i < size; i += 2*width)			\
+		{							\
+			int n1 = size - i < width ? size - i : width;	\
+			int n2 = size - i - n1 < width ? size - i - n1 : width; \
+									\
+			fn##_merge (to + i, from + i, n1, from + i + n1, n2); \
+		}							\
+		swap = from;						\
+		from = to;						\
+		to = swap;						\
+	}								\
+	if (from != records)						\
+	{								\
+		memcpy (records, from, size*sizeof (record_t));		\
+		free (from);						\
+	}								\
+	else								\
+		free (to);						\
+}
+
+/*
+ * The run sort finds the ascending and strictly descending runs already
+ * in the input, reversing the descending ones, and extends runs shorter
+ * than MERGE_RUN by insertion.  Runs are merged in the order powersort
+ * gives, from where their midpoints fall in the array, so the merge tree
+ * is close to optimal for the run lengths found.  A merge first skips
+ * the records already in place at either end, then switches to
+ * galloping whenever one side wins RUN_GALLOP times in a row, so sorted
+ * input takes n - 1 comparisons and a sorted file with a short tail
+ * appended costs little more than the tail.
+ */
+#define RUN_GALLOP 7
+#define MAX_PENDING 64
+
+typedef struct {
+	int start, len, power;
+} pending_run_t;
+
+static inline int run_power (int s1, int n1, int n2, int n)
+/*
+ * Depth in the powersort merge tree of the boundary between the runs
+ * at s1 of n1 records and at s1 + n1 of n2 records, out of n
+ */
+{
+	long a = 2L*s1 + n1, b = a + n1 + n2;
+	int power = 0;
+
+	for (;;)
+	{
+		power++;
+		if (a >= n)
+		{
+			a -= n;
+			b -= n;
+		}
+		else if (b >= n)
+			break;
+		a <<= 1;
+		b <<= 1;
+	}
+	return power;
+}
+
+#define DEFINE_RUN_SORT(fn, KEY)					\
+DEFINE_HEAP_SORT (fn, KEY)						\
+									\
+static int fn##_gallop_left (const record_t *key, record_t a[], int n)	\
+{									\
+	/* First of a[0..n) not less than key */			\
+	int lo = 0, hi = 1;						\
+									\
+	while (hi < n && record_less (&a[hi - 1], key, KEY))		\
+	{								\
+		lo = hi;						\
+		hi = 2*hi + 1;						\
+	}								\
+	if (hi > n)							\
+		hi = n;							\
+	while (lo < hi)							\
+	{								\
+		int mid = lo + (hi - lo)/2;				\
+		if (record_less (&a[mid], key, KEY))			\
+			lo = mid + 1;					\
+		else							\
+			hi = mid;					\
+	}								\
+	return lo;							\
+}									\
+									\
+static int fn##_gallop_right (const record_t *key, record_t a[], int n) \
+{									\
+	/* First of a[0..n) greater than key */				\
+	int lo = 0, hi = 1;						\
+									\
+	while (hi < n && !record_less (key, &a[hi - 1], KEY))		\
+	{								\
+		lo = hi;						\
+		hi = 2*hi + 1;						\
+	}								\
+	if (hi > n)							\
+		hi = n;							\
+	while (lo < hi)							\
+	{								\
+		int mid = lo + (hi - lo)/2;				\
+		if (record_less (key, &a[mid], KEY))			\
+			hi = mid;					\
+		else							\
+			lo = mid + 1;					\
+	}								\
+	return lo;							\
+}									\
+									\
+static int fn##_find_run (record_t a[], int n, int want)		\
+{									\
+	/* Length of the run at a, made ascending and extended by	\
+	   insertion to want records */					\
+	int len = 1, i, j;						\
+									\
+	if (n == 1)							\
+		return 1;						\
+	if (record_less (&a[1], &a[0], KEY))				\
+	{								\
+		for (len = 2; len < n && record_less (&a[len], &a[len - 1], KEY); len++) \
+			;						\
+		for (i = 0, j = len - 1; i < j; i++, j--)		\
+		{							\
+			record_t temp = a[i];				\
+			a[i] = a[j];					\
+			a[j] = temp;					\
+		}							\
+	}								\
+	else								\
+		for (len = 2; len < n && !record_less (&a[len], &a[len - 1], KEY); len++) \
+			;						\
+	if (want > n)							\
+		want = n;						\
+	for (; len < want; len++)					\
+	{								\
+		record_t temp = a[len];					\
+		i = fn##_gallop_right (&temp, a, len);			\
+		memmove (a + i + 1, a + i, (len - i)*sizeof (record_t)); \
+		a[i] = temp;						\
+	}								\
+	return len;							\
+}									\
+									\
+static void fn##_merge_lo (record_t a[], int n1, int n2, record_t tmp[]) \
+{									\
+	/* Merge forwards with the left run, the shorter, in tmp */	\
+	/* wins is the current streak, negative for the right run */	\
+	int i = 0, j = n1, d = 0, n = n1 + n2, k1, k2, wins;		\
+									\
+	memcpy (tmp, a, n1*sizeof (record_t));				\
+	while (i < n1 && j < n)						\
+	{								\
+		for (wins = 0; i < n1 && j < n; )			\
+		{							\
+			if (record_less (&a[j], &tmp[i], KEY))		\
+			{						\
+				wins = wins < 0 ? wins - 1 : -1;	\
+				a[d++] = a[j++];			\
+			}						\
+			else						\
+			{						\
+				wins = wins > 0 ? wins + 1 : 1;		\
+				a[d++] = tmp[i++];			\
+			}						\
+			if (wins >= RUN_GALLOP || -wins >= RUN_GALLOP)	\
+				break;					\
+		}							\
+		while (i < n1 && j < n)					\
+		{							\
+			k1 = fn##_gallop_right (&a[j], tmp + i, n1 - i); \
+			memcpy (a + d, tmp + i, k1*sizeof (record_t));	\
+			d += k1;					\
+			if ((i += k1) == n1)				\
+				break;					\
+			a[d++] = a[j++];				\
+			if (j == n)					\
+				break;					\
+			k2 = fn##_gallop_left (&tmp[i], a + j, n - j);	\
+			memmove (a + d, a + j, k2*sizeof (record_t));	\
+			d += k2;					\
+			if ((j += k2) == n)				\
+				break;					\
+			a[d++] = tmp[i++];				\
+			if (k1 < RUN_GALLOP && k2 < RUN_GALLOP)		\
+				break;					\
+		}							\
+	}								\
+	memcpy (a + d, tmp + i, (n1 - i)*sizeof (record_t));		\
+}									\
+									\
+static void fn##_merge_hi (record_t a[], int n1, int n2, record_t tmp[]) \
+{									\
+	/* Merge backwards with the right run, the shorter, in tmp */	\
+	int i = n1, j = n2, d = n1 + n2, k1, k2, wins;			\
+									\
+	memcpy (tmp, a + n1, n2*sizeof (record_t));			\
+	while (i > 0 && j > 0)						\
+	{								\
+		for (wins = 0; i > 0 && j > 0; )			\
+		{							\
+			if (record_less (&tmp[j - 1], &a[i - 1], KEY))	\
+			{						\
+				wins = wins > 0 ? wins + 1 : 1;		\
+				a[--d] = a[--i];			\
+			}						\
+			else						\
+			{						\
+				wins = wins < 0 ? wins - 1 : -1;	\
+				a[--d] = tmp[--j];			\
+			}						\
+			if (wins >= RUN_GALLOP || -wins >= RUN_GALLOP)	\
+				break;					\
+		}							\
+		while (i > 0 && j > 0)					\
+		{							\
+			k1 = i - fn##_gallop_right (&tmp[j - 1], a, i);	\
+			d -= k1;					\
+			i -= k1;					\
+			memmove (a + d, a + i, k1*sizeof (record_t));	\
+			if (i == 0)					\
+				break;					\
+			a[--d] = tmp[--j];				\
+			if (j == 0)					\
+				break;					\
+			k2 = j - fn##_gallop_left (&a[i - 1], tmp, j);	\
+			d -= k2;					\
+			j -= k2;					\
+			memcpy (a + d, tmp + j, k2*sizeof (record_t));	\
+			if (j == 0)					\
+				break;					\
+			a[--d] = a[--i];				\
+			if (k1 < RUN_GALLOP && k2 < RUN_GALLOP)		\
+				break;					\
+		}							\
+	}								\
+	memcpy (a, tmp, j*sizeof (record_t));				\
+}									\
+									\
+static void fn##_merge_runs (record_t a[], int n1, int n2, record_t tmp[]) \
+{									\
+	int k;								\
+									\
+	/* The start of the left run and the end of the right one may	\
+	   already be in place */					\
+	k = fn##_gallop_right (&a[n1], a, n1);				\
+	a += k;								\
+	if ((n1 -= k) == 0)						\
+		return;							\
+	if ((n2 = fn##_gallop_left (&a[n1 - 1], a + n1, n2)) == 0)	\
+		return;							\
+	if (n1 <= n2)							\
+		fn##_merge_lo (a, n1, n2, tmp);				\
+	else								\
+		fn##_merge_hi (a, n1, n2, tmp);				\
+}									\
+									\
+void fn (int size, record_t records[])					\
+{									\
+	pending_run_t stack[MAX_PENDING];				\
+	record_t *tmp;							\
+	int top = 0, start, len, power;					\
+									\
+	if (size < 2)							\
+		return;							\
+	if ((tmp = malloc ((size/2 + 1)*sizeof (record_t))) == NULL)	\
+	{								\
+		fn##_heap (records, size);				\
+		return;							\
+	}								\
+									\
+	start = 0;							\
+	len = fn##_find_run (records, size, MERGE_RUN);			\
+	while (start + len < size)					\
+	{								\
+		int next = start + len;					\
+		int n2 = fn##_find_run (records + next, size - next, MERGE_RUN); \
+									\
+		power = run_power (start, len, n2, size);		\
+		while (top > 0 && stack[top - 1].power > power)		\
+		{							\
+			top--;						\
+			fn##_merge_runs (records + stack[top].start,	\
+				stack[top].len, len, tmp);		\
+			len += stack[top].len;				\
+			start = stack[top].start;			\
+		}							\
+		stack[top].start = start;				\
+		stack[top].len = len;					\
+		stack[top++].power = power;				\
+		start = next;						\
+		len = n2;						\
+	}								\
+	while (top > 0)							\
+	{								\
+		top--;							\
+		fn##_merge_runs (records + stack[top].start,		\
+			stack[top].len, len, tmp);			\
+		len += stack[top].len;					\
+	}								\
+	free (tmp);							\
+}
+
+#endif /*SORT_CORE_H_*/
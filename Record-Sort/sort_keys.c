@@ -0,0 +1,160 @@
+/*
+ * Stable sorts for every key of the record_sort example
+ *
+ * One merge sort is instantiated from sort_core.h for each key of one
+ * or two fields in either direction, so every comparison is inlined for
+ * its key.  key_sorter() picks the instance for a key at run time, and
+ * choose_sorter() the sort for a key and -a algorithm.
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.
+ * If not, see <https://www.gnu.org/licenses/>
+ */
+
+#include <stdlib.h>
+#include <string.h>
+
+#include "record_sort.h"
+#include "sort_core.h"
+
+#define NAME_DESC	(SORT_NAME | SORT_DESC)
+#define ID_DESC		(SORT_ID | SORT_DESC)
+
+DEFINE_MERGE_SORT (merge_name, SORT_NAME)
+DEFINE_MERGE_SORT (merge_name_desc, NAME_DESC)
+DEFINE_MERGE_SORT (merge_ID, SORT_ID)
+DEFINE_MERGE_SORT (merge_ID_desc, ID_DESC)
+
+DEFINE_MERGE_SORT (merge_name_ID, SORT_KEY2 (SORT_NAME, SORT_ID))
+DEFINE_MERGE_SORT (merge_name_ID_desc, SORT_KEY2 (SORT_NAME, ID_DESC))
+DEFINE_MERGE_SORT (merge_name_desc_ID, SORT_KEY2 (NAME_DESC, SORT_ID))
+DEFINE_MERGE_SORT (merge_name_desc_ID_desc, SORT_KEY2 (NAME_DESC, ID_DESC))
+
+DEFINE_MERGE_SORT (merge_ID_name, SORT_KEY2 (SORT_ID, SORT_NAME))
+DEFINE_MERGE_SORT (merge_ID_name_desc, SORT_KEY2 (SORT_ID, NAME_DESC))
+DEFINE_MERGE_SORT (merge_ID_desc_name, SORT_KEY2 (ID_DESC, SORT_NAME))
+DEFINE_MERGE_SORT (merge_ID_desc_name_desc, SORT_KEY2 (ID_DESC, NAME_DESC))
+
+DEFINE_RUN_SORT (run_name, SORT_NAME)
+DEFINE_RUN_SORT (run_name_desc, NAME_DESC)
+DEFINE_RUN_SORT (run_ID, SORT_ID)
+DEFINE_RUN_SORT (run_ID_desc, ID_DESC)
+
+DEFINE_RUN_SORT (run_name_ID, SORT_KEY2 (SORT_NAME, SORT_ID))
+DEFINE_RUN_SORT (run_name_ID_desc, SORT_KEY2 (SORT_NAME, ID_DESC))
+DEFINE_RUN_SORT (run_name_desc_ID, SORT_KEY2 (NAME_DESC, SORT_ID))
+DEFINE_RUN_SORT (run_name_desc_ID_desc, SORT_KEY2 (NAME_DESC, ID_DESC))
+
+DEFINE_RUN_SORT (run_ID_name, SORT_KEY2 (SORT_ID, SORT_NAME))
+DEFINE_RUN_SORT (run_ID_name_desc, SORT_KEY2 (SORT_ID, NAME_DESC))
+DEFINE_RUN_SORT (run_ID_desc_name, SORT_KEY2 (ID_DESC, SORT_NAME))
+DEFINE_RUN_SORT (run_ID_desc_name_desc, SORT_KEY2 (ID_DESC, NAME_DESC))
+
+static const struct {
+	int key;
+	sort_fn merge, run;
+} key_sorters[] = {
+	{SORT_NAME, merge_name, run_name},
+	{NAME_DESC, merge_name_desc, run_name_desc},
+	{SORT_ID, merge_ID, run_ID},
+	{ID_DESC, merge_ID_desc, run_ID_desc},
+	{SORT_KEY2 (SORT_NAME, SORT_ID), merge_name_ID, run_name_ID},
+	{SORT_KEY2 (SORT_NAME, ID_DESC), merge_name_ID_desc, run_name_ID_desc},
+	{SORT_KEY2 (NAME_DESC, SORT_ID), merge_name_desc_ID, run_name_desc_ID},
+	{SORT_KEY2 (NAME_DESC, ID_DESC), merge_name_desc_ID_desc, run_name_desc_ID_desc},
+	{SORT_KEY2 (SORT_ID, SORT_NAME), merge_ID_name, run_ID_name},
+	{SORT_KEY2 (SORT_ID, NAME_DESC), merge_ID_name_desc, run_ID_name_desc},
+	{SORT_KEY2 (ID_DESC, SORT_NAME), merge_ID_desc_name, run_ID_desc_name},
+	{SORT_KEY2 (ID_DESC, NAME_DESC), merge_ID_desc_name_desc, run_ID_desc_name_desc},
+};
+
+sort_fn key_sorter (int key, int algo)
+/*
+ * The stable sort instantiated for key, the run sort for ALGO_ADAPTIVE
+ * and the merge sort otherwise, or NULL if there is none
+ */
+{
+	size_t i;
+
+	for (i = 0; i < sizeof (key_sorters)/sizeof (key_sorters[0]); i++)
+		if (key_sorters[i].key == key)
+			return algo == ALGO_ADAPTIVE ? key_sorters[i].run : key_sorters[i].merge;
+	return NULL;
+}
+
+int parse_key (const char *arg)
+/*
+ * Sort key from "1", "2" or a list of up to two fields such as
+ * "name,id:desc", where ":desc" sorts that field in descending order.
+ * Returns 0 for a key that isn't valid.
+ */
+{
+	int key = 0, field, shift = 0;
+	size_t len;
+
+	// The old numeric arguments; other numbers aren't keys
+	if (strcmp (arg, "1") == 0)
+		return SORT_NAME;
+	if (strcmp (arg, "2") == 0)
+		return SORT_ID;
+	while (*arg)
+	{
+		len = strcspn (arg, ",");
+		if (len > 5 && strncmp (arg + len - 5, ":desc", 5) == 0)
+			field = SORT_DESC;
+		else
+			field = 0;
+		if (strncmp (arg, "name", 4) == 0 && len - (field ? 5 : 0) == 4)
+			field |= SORT_NAME;
+		else if (strncmp (arg, "id", 2) == 0 && len - (field ? 5 : 0) == 2)
+			field |= SORT_ID;
+		else
+			return 0;
+		key |= field << shift;
+		shift += SORT_FIELD_BITS;
+		arg += len;
+		if (*arg == ',')
+			arg++;
+	}
+	return key;
+}
+
+int parse_algo (const char *arg)
+/*
+ * ALGO_ number for an -a argument, or -1 if it isn't known
+ */
+{
+	if (strcmp (arg, "radix") == 0)
+		return ALGO_RADIX;
+	if (strcmp (arg, "shell") == 0)
+		return ALGO_SHELL;
+	if (strcmp (arg, "merge") == 0)
+		return ALGO_MERGE;
+	if (strcmp (arg, "adaptive") == 0)
+		return ALGO_ADAPTIVE;
+	return -1;
+}
+
+sort_fn choose_sorter (int key, int algo)
+/*
+ * The sort to use for key with algo.  Keys other than plain name or ID
+ * always take a stable merge sort, or the run sort with ALGO_ADAPTIVE.
+ * Returns NULL for a key that isn't valid.
+ */
+{
+	if (key == SORT_NAME && (algo == ALGO_RADIX || algo == ALGO_SHELL))
+		return algo == ALGO_SHELL ? sort_name : sort_name_radix;
+	if (key == SORT_ID && (algo == ALGO_RADIX || algo == ALGO_SHELL))
+		return algo == ALGO_SHELL ? sort_ID : sort_ID_radix;
+	return key_sorter (key, algo);
+}
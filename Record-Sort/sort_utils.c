@@ -18,8 +18,168 @@
 #include <stdio.h>
 #include <stdlib.h>
 #include <string.h>
+#include <ctype.h>
+#include <time.h>
+#include <unistd.h>
 
 #include "record_sort.h"
+#include "sort_core.h"
+
+arena_t name_arena;
+
+double now_ms (void)
+/*
+ * Monotonic clock in milliseconds, for timing the phases
+ */
+{
+	struct timespec ts;
+
+	clock_gettime (CLOCK_MONOTONIC, &ts);
+	return ts.tv_sec*1e3 + ts.tv_nsec/1e6;
+}
+
+/*
+ * Field separators.  A zero byte counts as one so a buffer can be
+ * scanned again after its names have been terminated in place.
+ */
+#define IS_SEP(c) (isspace ((unsigned char) (c)) || (c) == '\0')
+
+char *scan_record (char *p, char *end, record_t *rec)
+/*
+ * Hand-written equivalent of fscanf (file, "%s %d\n", ...) over an
+ * in-memory buffer.  The name is terminated in place and rec->name
+ * points at it.  Returns the position after the record, or NULL when
+ * no complete record is left, which is where fscanf would stop.
+ *
+ * The buffer must have a readable byte at end.
+ */
+{
+	unsigned int id = 0;
+	int neg = 0;
+	char *digits;
+
+	while (p < end && IS_SEP (*p))
+		p++;
+	if (p == end)
+		return NULL;
+	rec->name = p;
+	while (p < end && !IS_SEP (*p))
+		p++;
+	if (p == end)
+		return NULL;
+	*p++ = '\0';
+	while (p < end && IS_SEP (*p))
+		p++;
+
+	if (p < end && (*p == '-' || *p == '+'))
+		neg = *p++ == '-';
+	for (digits = p; p < end && *p >= '0' && *p <= '9'; p++)
+		id = id*10 + (*p - '0');
+	if (p == digits)
+		return NULL;
+	rec->ID = neg ? -id : id;
+
+	while (p < end && IS_SEP (*p))
+		p++;
+	return p;
+}
+
+void open_reader (reader_t *rd, FILE *file)
+/*
+ * Set up a reader on an open file
+ */
+{
+	rd->file = file;
+	rd->line = rd->next = NULL;
+	rd->cap = rd->next_cap = 0;
+	rd->pos = rd->end = NULL;
+}
+
+static int name_only (const char *p, const char *end)
+/*
+ * Whether p..end holds just a name, a record whose ID is on a later line
+ */
+{
+	while (p < end && !IS_SEP (*p))
+		p++;
+	while (p < end && IS_SEP (*p))
+		p++;
+	return p == end;
+}
+
+int next_record (reader_t *rd, record_t *rec)
+/*
+ * Fetch the next record from the reader's file.  rec->name points into
+ * the reader's line buffer and is only good until the next call.
+ * Returns 1 for a record, 0 at end of file or at the first text that
+ * doesn't make a record, which is where fscanf would stop, and -1 if
+ * a split record couldn't be joined for lack of memory.  A record
+ * may be split across lines, as fscanf allows: a name left at the end
+ * of a line is joined with the next line.
+ */
+{
+	ssize_t len;
+	size_t keep = 0;
+	char *p, *grown;
+
+	while (1)
+	{
+		if (rd->pos != NULL)
+		{
+			if ((p = scan_record (rd->pos, rd->end, rec)) != NULL)
+			{
+				rd->pos = p;
+				return 1;
+			}
+			while (rd->pos < rd->end && IS_SEP (*rd->pos))
+				rd->pos++;
+			if (rd->pos != rd->end)
+			{
+				if (!name_only (rd->pos, rd->end))
+					return 0;
+				keep = rd->end - rd->pos;
+			}
+		}
+		if (keep == 0)
+		{
+			if ((len = getline (&rd->line, &rd->cap, rd->file)) < 0)
+				return 0;
+			rd->pos = rd->line;
+			rd->end = rd->line + len;
+			continue;
+		}
+
+		// Join the name with the next line, which should hold its ID
+		if ((len = getline (&rd->next, &rd->next_cap, rd->file)) < 0)
+			return 0;
+		if (keep + len + 1 > rd->cap)
+		{
+			if ((grown = malloc (keep + len + 1)) == NULL)
+				return -1;
+			memcpy (grown, rd->pos, keep);
+			free (rd->line);
+			rd->line = grown;
+			rd->cap = keep + len + 1;
+		}
+		else
+			memmove (rd->line, rd->pos, keep);
+		memcpy (rd->line + keep, rd->next, len + 1);
+		rd->pos = rd->line;
+		rd->end = rd->line + keep + len;
+		keep = 0;
+	}
+}
+
+void close_reader (reader_t *rd)
+/*
+ * Free the reader's line buffers.  The file is left open.
+ */
+{
+	free (rd->line);
+	free (rd->next);
+	rd->line = rd->next = rd->pos = rd->end = NULL;
+	rd->cap = rd->next_cap = 0;
+}
 
 int read_file (char *filename, int *size, record_t *records[])
 /*
@@ -28,34 +188,58 @@ int read_file (char *filename, int *size, record_t *records[])
  * in the name field are replaced by '_'.
  * 
  * Returns the number of records in the file and an array of
- * records.
+ * records.  Names are copied into name_arena, so there is no
+ * limit on their length.  A filename of "-" reads stdin.
+ *
+ * Returns 0, or -1 if the file can't be opened or memory runs out,
+ * in which case nothing is returned and the arena is released.
  */
 {
-	int i, n, nrecs = 0;
+	int nrecs = 0, cap = 1024, got;
 	FILE *file;
-	record_t *temp = NULL;
+	reader_t rd;
+	record_t rec, *temp, *grown;
 	
-	if ((file = fopen (filename, "r")) == 0)
+	if (strcmp (filename, "-") == 0)
+		file = stdin;
+	else if ((file = fopen (filename, "r")) == 0)
+		return -1;
+	if ((temp = malloc (cap*sizeof (record_t))) == NULL)
+	{
+		if (file != stdin)
+			fclose (file);
 		return -1;
+	}
 	
-	do
+	open_reader (&rd, file);
+	while ((got = next_record (&rd, &rec)) > 0)
 	{
-		temp = realloc (temp, (nrecs + 10)*sizeof (record_t));
-		
-		for (i = nrecs; i < nrecs + 10; i++)
+		if (nrecs == cap)
 		{
-			temp[i].name = malloc (40);
-			if ((n = fscanf (file, "%s %d\n", temp[i].name, &temp[i].ID)) != 2)
-			{
-				free (temp[i].name);
-				*size = i - 1;
-				*records = temp;
+			if ((grown = realloc (temp, 2*cap*sizeof (record_t))) == NULL)
 				break;
-			}
+			temp = grown;
+			cap *= 2;
 		}
-		nrecs += 10;
+		temp[nrecs].name = arena_strndup (&name_arena, rec.name,
+			strlen (rec.name));
+		if (temp[nrecs].name == NULL)
+			break;
+		temp[nrecs++].ID = rec.ID;
 	}
-	while (n == 2);
+	close_reader (&rd);
+	if (file != stdin)
+		fclose (file);
+	if (got != 0)
+	{
+		// Out of memory: a partial file would sort as if it were whole
+		free (temp);
+		arena_release (&name_arena);
+		return -1;
+	}
+	
+	*size = nrecs;
+	*records = temp;
 	return 0;
 }
 
@@ -63,77 +247,48 @@ int write_sorted (int size, record_t records[])
 /*
  * Write the sorted file to stdout
  */
+{
+	fflush (stdout);
+	return write_records (STDOUT_FILENO, size, records);
+}
+
+int write_records (int fd, int size, record_t records[])
+/*
+ * Write the records to fd in the write_sorted() format through a
+ * buffered writer.  Returns 0, or -1 if the output couldn't be written.
+ */
 {
 	int i;
+	writer_t w;
 	
+	if (open_writer (&w, fd))
+		return -1;
 	for (i = 0; i < size; i++) // pyadav - correction
-		printf ("%-40s %d\n", records[i].name, records[i].ID);
-	return 0;
+		put_record (&w, records[i].name, records[i].ID);
+	return close_writer (&w);
 }
 
 void return_records (int size, record_t records[])
 /*
- * Free the memory that was allocated for the name fields and the records array
+ * Free the memory that was allocated for the name fields and the records array.
+ * The names live in name_arena or in the map_file() mapping, so this is
+ * a handful of chunk releases regardless of size.
  */
 {
-	int i;
-	
-	for (i = 0; i < size; i++)
-		free (records[i].name);
+	// size was needed to free the names one at a time; it is kept so
+	// the callers don't change
+	(void) size;
+	release_mapping ();
+	arena_release (&name_arena);
 	free (records);
 }
 
-void sort_name (int size, record_t records[])
 /*
  * Sort records in ascending order by name using the shell sort algorithm
  */
-{
-	int i, j;
-	int h = 1;
-
-	do
-		h = h*3 + 1;
-	while (h <= size);
-	
-	do
-	{
-		h /= 3;
-		for (i = h; i < size; i++)
-		{
-			record_t temp = records[i];
-			for (j = i;
-				j >= h && strcmp (records[j - h].name, temp.name) > 0; j -= h)
-				records[j] = records[j - h];
-			if (i != j)
-				records[j] = temp;
-		}
-	}
-	while (h != 1);	
-}
+DEFINE_SHELL_SORT (sort_name, SORT_NAME)
 
-void sort_ID (int size, record_t records[])
 /*
  * Sort records in ascending order by ID using the shell sort algorithm
  */
-{
-	int i, j;
-	int h = 1;
-
-	do
-		h = h*3 + 1;
-	while (h <= size);
-	
-	do
-	{
-		h /= 3;
-		for (i = h; i < size; i++)
-		{
-			record_t temp = records[i];
-			for (j = i; j >= h && records[j - h].ID > temp.ID; j -= h)
-				records[j] = records[j - h];
-			if (i != j)
-				records[j] = temp;
-		}
-	}
-	while (h != 1);
-}
+DEFINE_SHELL_SORT (sort_ID, SORT_ID)
@@ -0,0 +1,363 @@
+/*
+ * Pipelined sort of standard input for the record_sort example
+ *
+ * The calling thread reads records from stdin into batches while a
+ * sorter thread sorts each finished batch and merges it into a stack of
+ * sorted runs, so reading, sorting and most of the merging overlap.
+ *
+ * The reader never waits for the sorter.  A batch is handed over once
+ * it holds BATCH_RECORDS records and the queue has room; while the
+ * sorter is still busy with earlier batches, the current batch just
+ * keeps growing, so a producer writing into the pipe is never held up.
+ * Bigger batches then give the sorter bigger, cheaper units of work
+ * and it catches up.
+ *
+ * Runs are merged as they arrive whenever the newest run is at least
+ * half the size of the one below it, which keeps the stack to a few
+ * runs of geometrically falling size.  Nothing can be written before the
+ * last record has been read, since it may sort first, but by then all
+ * that is left is one k-way merge of the remaining runs, streamed
+ * straight to the output.
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.
+ * If not, see <https://www.gnu.org/licenses/>
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <pthread.h>
+
+#include "record_sort.h"
+
+/*
+ * Records in a batch before it is handed to the sorter, and how many
+ * finished batches may wait for it
+ */
+#define BATCH_RECORDS (64*1024)
+#define QUEUE_DEPTH 2
+
+/*
+ * Runs on the stack.  Each run is more than twice the size of the one
+ * above it, so 32 is enough for any int record count.
+ */
+#define MAX_RUNS 32
+
+typedef struct batch {
+	record_t *records;
+	int size, cap;
+	struct batch *next;
+} batch_t;
+
+typedef struct {
+	record_t *records;
+	int size;
+} stream_run_t;
+
+typedef struct {
+	pthread_mutex_t lock;
+	pthread_cond_t ready;
+	batch_t *head, *tail;	// finished batches waiting for the sorter
+	int pending;
+	int done;		// the last batch has been queued
+
+	sort_fn sorter;
+	int key;
+	stream_run_t runs[MAX_RUNS];	// oldest at the bottom
+	int nruns;
+	int error;
+
+	int batches, largest;
+	double sort_ms, merge_ms;
+} stream_t;
+
+static batch_t *new_batch (void)
+{
+	batch_t *b = malloc (sizeof (batch_t));
+
+	if (b == NULL)
+		return NULL;
+	b->size = 0;
+	b->cap = BATCH_RECORDS;
+	b->next = NULL;
+	if ((b->records = malloc (b->cap*sizeof (record_t))) == NULL)
+	{
+		free (b);
+		return NULL;
+	}
+	return b;
+}
+
+static int hand_off (stream_t *s, batch_t *b, int last)
+/*
+ * Queue b for the sorter.  Unless this is the last batch, only when
+ * there is room, so the reader never blocks.  Returns 1 if b was queued.
+ */
+{
+	int queued = 0;
+
+	pthread_mutex_lock (&s->lock);
+	if (last || s->pending < QUEUE_DEPTH)
+	{
+		if (s->tail)
+			s->tail->next = b;
+		else
+			s->head = b;
+		s->tail = b;
+		s->pending++;
+		s->done = last;
+		queued = 1;
+		pthread_cond_signal (&s->ready);
+	}
+	pthread_mutex_unlock (&s->lock);
+	return queued;
+}
+
+static int merge_top (stream_t *s)
+/*
+ * Replace the two newest runs by their stable merge.  Returns 0, or -1
+ * if memory ran out.
+ */
+{
+	stream_run_t *a = &s->runs[s->nruns - 2], *b = &s->runs[s->nruns - 1];
+	record_t *out;
+	int i = 0, j = 0, k = 0;
+
+	if ((out = malloc ((a->size + b->size)*sizeof (record_t))) == NULL)
+		return -1;
+	while (i < a->size && j < b->size)
+		out[k++] = record_less (&b->records[j], &a->records[i], s->key)
+			? b->records[j++] : a->records[i++];
+	memcpy (out + k, a->records + i, (a->size - i)*sizeof (record_t));
+	memcpy (out + k + a->size - i, b->records + j, (b->size - j)*sizeof (record_t));
+
+	free (a->records);
+	free (b->records);
+	a->records = out;
+	a->size += b->size;
+	s->nruns--;
+	return 0;
+}
+
+static void *sort_batches (void *arg)
+/*
+ * The sorter thread: sort each batch and merge it into the run stack
+ */
+{
+	stream_t *s = arg;
+	batch_t *b;
+	double start;
+
+	for (;;)
+	{
+		pthread_mutex_lock (&s->lock);
+		while (s->head == NULL && !s->done)
+			pthread_cond_wait (&s->ready, &s->lock);
+		if ((b = s->head) == NULL)
+		{
+			pthread_mutex_unlock (&s->lock);
+			break;
+		}
+		if ((s->head = b->next) == NULL)
+			s->tail = NULL;
+		s->pending--;
+		pthread_mutex_unlock (&s->lock);
+
+		s->batches++;
+		if (b->size > s->largest)
+			s->largest = b->size;
+		start = now_ms ();
+		s->sorter (b->size, b->records);
+		s->sort_ms += now_ms () - start;
+
+		start = now_ms ();
+		s->runs[s->nruns].records = b->records;
+		s->runs[s->nruns++].size = b->size;
+		free (b);
+		while (s->nruns >= 2
+			&& s->runs[s->nruns - 2].size <= 2*(long) s->runs[s->nruns - 1].size)
+			if (merge_top (s))
+			{
+				s->error = 1;
+				break;
+			}
+		s->merge_ms += now_ms () - start;
+		if (s->error)
+			break;
+	}
+	return NULL;
+}
+
+typedef struct {
+	record_t *rec, *end;	// next record of a run and the run's end
+	int seq;		// run's place on the stack, breaks ties
+} cursor_t;
+
+static inline int cursor_less (cursor_t *a, cursor_t *b, int key)
+{
+	if (record_less (a->rec, b->rec, key))
+		return 1;
+	if (record_less (b->rec, a->rec, key))
+		return 0;
+	return a->seq < b->seq;
+}
+
+static void sift_down (cursor_t heap[], int n, int i, int key)
+{
+	cursor_t top = heap[i];
+	int child;
+
+	while ((child = 2*i + 1) < n)
+	{
+		if (child + 1 < n && cursor_less (&heap[child + 1], &heap[child], key))
+			child++;
+		if (!cursor_less (&heap[child], &top, key))
+			break;
+		heap[i] = heap[child];
+		i = child;
+	}
+	heap[i] = top;
+}
+
+int stream_sort (int out, sort_fn sorter, int key, int verbose)
+/*
+ * Sort the records on stdin to the out descriptor.  Returns 0, or -1 if
+ * memory runs out or the output can't be written.
+ */
+{
+	stream_t s;
+	pthread_t thread;
+	reader_t rd;
+	record_t rec;
+	batch_t *b;
+	cursor_t heap[MAX_RUNS];
+	int i, n, got, next_try = BATCH_RECORDS, total = 0, result = 0;
+	record_t *grown;
+	writer_t w;
+	double start = now_ms ();
+
+	memset (&s, 0, sizeof (s));
+	pthread_mutex_init (&s.lock, NULL);
+	pthread_cond_init (&s.ready, NULL);
+	s.sorter = sorter;
+	s.key = key;
+	if ((b = new_batch ()) == NULL)
+		return -1;
+	if (pthread_create (&thread, NULL, sort_batches, &s) != 0)
+	{
+		free (b->records);
+		free (b);
+		return -1;
+	}
+
+	setvbuf (stdin, NULL, _IOFBF, 1 << 20);
+	open_reader (&rd, stdin);
+	while ((got = next_record (&rd, &rec)) > 0)
+	{
+		if (b->size == b->cap)
+		{
+			if ((grown = realloc (b->records, 2*b->cap*sizeof (record_t))) == NULL)
+			{
+				result = -1;
+				break;
+			}
+			b->records = grown;
+			b->cap *= 2;
+		}
+		if ((b->records[b->size].name = arena_strndup (&name_arena, rec.name,
+				strlen (rec.name))) == NULL)
+		{
+			result = -1;
+			break;
+		}
+		b->records[b->size++].ID = rec.ID;
+		total++;
+
+		// Try to hand over every quarter batch once the batch is full
+		if (b->size >= next_try)
+		{
+			if (hand_off (&s, b, 0))
+			{
+				if ((b = new_batch ()) == NULL)
+				{
+					result = -1;
+					break;
+				}
+				next_try = BATCH_RECORDS;
+			}
+			else
+				next_try = b->size + BATCH_RECORDS/4;
+		}
+	}
+	if (got < 0)
+		result = -1;
+	close_reader (&rd);
+	if (b == NULL)
+	{
+		// Nothing to hand over, but the sorter must still be told
+		pthread_mutex_lock (&s.lock);
+		s.done = 1;
+		pthread_cond_signal (&s.ready);
+		pthread_mutex_unlock (&s.lock);
+	}
+	else
+		hand_off (&s, b, 1);
+	pthread_join (thread, NULL);
+	if (verbose)
+		fprintf (stderr, "%d records read in %.3f ms; %d batches (largest %d) sorted in %.3f ms "
+			"and merged in %.3f ms while reading\n", total, now_ms () - start,
+			s.batches, s.largest, s.sort_ms, s.merge_ms);
+
+	// Final k-way merge of what is left on the stack, straight to out
+	start = now_ms ();
+	if (s.error)
+		result = -1;
+	if (result == 0 && open_writer (&w, out) == 0)
+	{
+		for (i = n = 0; i < s.nruns; i++)
+			if (s.runs[i].size > 0)
+			{
+				heap[n].rec = s.runs[i].records;
+				heap[n].end = s.runs[i].records + s.runs[i].size;
+				heap[n++].seq = i;
+			}
+		for (i = n/2 - 1; i >= 0; i--)
+			sift_down (heap, n, i, key);
+		while (n > 0)
+		{
+			put_record (&w, heap[0].rec->name, heap[0].rec->ID);
+			if (++heap[0].rec == heap[0].end)
+				heap[0] = heap[--n];
+			sift_down (heap, n, 0, key);
+		}
+		result = close_writer (&w);
+	}
+	else
+		result = -1;
+	if (verbose)
+		fprintf (stderr, "final %d-way merge written in %.3f ms\n", s.nruns, now_ms () - start);
+
+	for (i = 0; i < s.nruns; i++)
+		free (s.runs[i].records);
+	while ((b = s.head) != NULL)
+	{
+		s.head = b->next;
+		free (b->records);
+		free (b);
+	}
+	arena_release (&name_arena);
+	pthread_mutex_destroy (&s.lock);
+	pthread_cond_destroy (&s.ready);
+	return result;
+}
@@ -0,0 +1,189 @@
+/*
+ * Top-K output for the record_sort example
+ *
+ * When only the first K records of the sorted output are wanted, the
+ * records are streamed through a bounded max-heap holding the K best
+ * seen so far.  A record that doesn't beat the worst of those is turned
+ * away after one comparison, without copying its name, so the work is
+ * O(n log K) at worst and close to one comparison per record for
+ * typical input.  Only the K kept names are stored, so memory is O(K)
+ * whatever the size of the datafile.
+ *
+ * Ties are broken on input position, so the K records written are
+ * exactly the first K lines of the full stable sort.
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.
+ * If not, see <https://www.gnu.org/licenses/>
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "record_sort.h"
+
+typedef struct {
+	record_t rec;		// name is owned by the heap
+	unsigned long seq;	// input position, breaks ties
+} top_t;
+
+typedef struct {
+	top_t *heap;		// max-heap, worst kept record on top
+	int size, k, key;
+	unsigned long seq;
+} top_heap_t;
+
+static inline int top_less (const top_t *a, const top_t *b, int key)
+{
+	if (record_less (&a->rec, &b->rec, key))
+		return 1;
+	if (record_less (&b->rec, &a->rec, key))
+		return 0;
+	return a->seq < b->seq;
+}
+
+static void sift_up (top_heap_t *t, int i)
+{
+	top_t item = t->heap[i];
+	int parent;
+
+	while (i > 0 && top_less (&t->heap[parent = (i - 1)/2], &item, t->key))
+	{
+		t->heap[i] = t->heap[parent];
+		i = parent;
+	}
+	t->heap[i] = item;
+}
+
+static void sift_down (top_heap_t *t, int n, int i)
+{
+	top_t item = t->heap[i];
+	int child;
+
+	while ((child = 2*i + 1) < n)
+	{
+		if (child + 1 < n && top_less (&t->heap[child], &t->heap[child + 1], t->key))
+			child++;
+		if (!top_less (&item, &t->heap[child], t->key))
+			break;
+		t->heap[i] = t->heap[child];
+		i = child;
+	}
+	t->heap[i] = item;
+}
+
+static int offer (top_heap_t *t, record_t *rec)
+/*
+ * Keep rec if it is among the K best so far.  The name is copied only
+ * when it is kept.  Returns 0, or -1 if memory ran out.
+ */
+{
+	top_t item;
+
+	item.rec = *rec;
+	item.seq = t->seq++;
+	if (t->size == t->k)
+	{
+		// Later input loses ties, so not less than the worst is out
+		if (!top_less (&item, &t->heap[0], t->key))
+			return 0;
+		free (t->heap[0].rec.name);
+		t->heap[0] = t->heap[--t->size];
+		sift_down (t, t->size, 0);
+	}
+	if ((item.rec.name = strdup (rec->name)) == NULL)
+		return -1;
+	t->heap[t->size] = item;
+	sift_up (t, t->size++);
+	return 0;
+}
+
+int top_sort (char *filename, int binary, int out, int key, int k, int verbose)
+/*
+ * Write the first k records of filename sorted on key to the out
+ * descriptor.  Text datafiles, and stdin for "-", are streamed; binary
+ * record files are mapped and scanned.  Returns 0, or -1 if the datafile
+ * can't be read, memory runs out or the output can't be written.
+ */
+{
+	top_heap_t t;
+	record_t rec, *records;
+	FILE *file;
+	reader_t rd;
+	writer_t w;
+	int i, n, got = 0, result = 0;
+	double start = now_ms ();
+
+	if (k <= 0)
+		return 0;
+	t.k = k;
+	t.key = key;
+	t.size = 0;
+	t.seq = 0;
+	if ((t.heap = malloc (k*sizeof (top_t))) == NULL)
+		return -1;
+
+	if (binary)
+	{
+		if (map_binary (filename, &n, &records))
+			result = -1;
+		else
+		{
+			for (i = 0; i < n && result == 0; i++)
+				result = offer (&t, &records[i]);
+			return_records (n, records);
+		}
+	}
+	else if ((file = strcmp (filename, "-") ? fopen (filename, "r") : stdin) == NULL)
+		result = -1;
+	else
+	{
+		setvbuf (file, NULL, _IOFBF, 1 << 20);
+		open_reader (&rd, file);
+		while (result == 0 && (got = next_record (&rd, &rec)) > 0)
+			result = offer (&t, &rec);
+		if (got < 0)
+			result = -1;
+		close_reader (&rd);
+		if (file != stdin)
+			fclose (file);
+	}
+	if (verbose)
+		fprintf (stderr, "%lu records scanned for the top %d in %.3f ms\n",
+			t.seq, k, now_ms () - start);
+
+	// Heapsort in place: popping the worst to the end leaves them in order
+	for (n = t.size; n > 1; n--)
+	{
+		top_t worst = t.heap[0];
+
+		t.heap[0] = t.heap[n - 1];
+		t.heap[n - 1] = worst;
+		sift_down (&t, n - 1, 0);
+	}
+
+	if (result == 0 && open_writer (&w, out) == 0)
+	{
+		for (i = 0; i < t.size; i++)
+			put_record (&w, t.heap[i].rec.name, t.heap[i].rec.ID);
+		result = close_writer (&w);
+	}
+	else
+		result = -1;
+
+	for (i = 0; i < t.size; i++)
+		free (t.heap[i].rec.name);
+	free (t.heap);
+	return result;
+}
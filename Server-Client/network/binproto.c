@@ -0,0 +1,143 @@
+/*
+ * binproto.c
+ *
+ * Binary framing for the thermostat parameters
+ *
+ * Polling the parameters with "? s" costs a strtok, an atoi and a
+ * sprintf on the server and the same again on the client for every
+ * value.  A frame instead carries a batch of fixed-width items, each an
+ * op, a parameter id (PARAM_* in params.h) and an int32 value, and is
+ * answered with a frame of the same length, one item per request item.
+ *
+ * Frames start with BIN_MAGIC, which no text command does, so both
+ * protocols share the port and the server tells them apart by the first
+ * byte of each message.
+ *
+ * The sets in a frame are committed together, so a reader sees all of
+ * them or none.  Every item, get or set, is then answered from one
+ * snapshot taken after the commit.  The temperature can be read but not
+ * set; it comes from the control loop.
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.
+ * If not, see <https://www.gnu.org/licenses/>
+*/
+#include <stdint.h>
+#include <string.h>
+#include <arpa/inet.h>
+
+#include "params.h"
+#include "binproto.h"
+
+static unsigned int get16 (const unsigned char *p)
+{
+  uint16_t v;
+
+  memcpy (&v, p, sizeof (v));
+  return ntohs (v);
+}
+
+static void put16 (unsigned char *p, unsigned int v)
+{
+  uint16_t n = htons (v);
+
+  memcpy (p, &n, sizeof (n));
+}
+
+static int get32 (const unsigned char *p)
+{
+  uint32_t v;
+
+  memcpy (&v, p, sizeof (v));
+  return (int32_t) ntohl (v);
+}
+
+static void put32 (unsigned char *p, int v)
+{
+  uint32_t n = htonl ((uint32_t) v);
+
+  memcpy (p, &n, sizeof (n));
+}
+
+int bin_frame_len (const unsigned char *buf, int len)
+/*
+    Length of the frame at the start of buf, which holds len bytes.
+    Returns 0 if the header hasn't all arrived yet, or -1 if it is not a
+    valid header.
+*/
+{
+  int count;
+
+  if (len < BIN_HEADER)
+    return len > 0 && buf[0] != BIN_MAGIC ? -1 : 0;
+  count = get16 (buf + 2);
+  if (buf[0] != BIN_MAGIC || buf[1] != BIN_VERSION || count < 1 || count > BIN_MAX_ITEMS)
+    return -1;
+  return BIN_HEADER + count*BIN_ITEM;
+}
+
+static int settable (int id)
+{
+  return id == PARAM_SETPOINT || id == PARAM_LIMIT || id == PARAM_DEADBAND;
+}
+
+int bin_reply (const unsigned char *frame, unsigned char *reply)
+/*
+    Carry out the complete, valid frame and build its reply, which is
+    the same length as frame and has room for BIN_MAX_FRAME bytes.
+    Returns the length of the reply.
+*/
+{
+  int count = get16 (frame + 2), i, op, id, nsets = 0;
+  int set_ids[BIN_MAX_ITEMS], set_values[BIN_MAX_ITEMS], value[NUM_PARAMS];
+  const unsigned char *item;
+  unsigned char *out;
+  params_t snap;
+
+  for (i = 0, item = frame + BIN_HEADER; i < count; i++, item += BIN_ITEM)
+  {
+    if (get16 (item) == BIN_SET && settable (id = get16 (item + 2)))
+    {
+      set_ids[nsets] = id;
+      set_values[nsets++] = get32 (item + 4);
+    }
+  }
+  if (nsets > 0)
+    params_set_many (set_ids, set_values, nsets);
+
+  params_get (&snap);
+  value[PARAM_SETPOINT] = snap.setpoint;
+  value[PARAM_LIMIT] = snap.limit;
+  value[PARAM_DEADBAND] = snap.deadband;
+  value[PARAM_VALUE] = snap.value;
+
+  memcpy (reply, frame, BIN_HEADER);
+  for (i = 0, item = frame + BIN_HEADER, out = reply + BIN_HEADER; i < count;
+       i++, item += BIN_ITEM, out += BIN_ITEM)
+  {
+    op = get16 (item);
+    id = get16 (item + 2);
+    if ((op == BIN_GET && id < NUM_PARAMS) || (op == BIN_SET && settable (id)))
+    {
+      put16 (out, op);
+      put32 (out + 4, value[id]);
+    }
+    else
+    {
+      put16 (out, BIN_ERROR);
+      put32 (out + 4, 0);
+    }
+    put16 (out + 2, id);
+  }
+  return BIN_HEADER + count*BIN_ITEM;
+}
@@ -0,0 +1,45 @@
+/*
+ * binproto.h
+ *
+ * Binary framing for the thermostat parameters, served on the same port
+ * as the text commands (see binproto.c).
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.
+ * If not, see <https://www.gnu.org/licenses/>
+*/
+#ifndef BINPROTO_H_
+#define BINPROTO_H_
+
+// First byte of every frame; no text command starts with it
+#define BIN_MAGIC   0xB7
+#define BIN_VERSION 1
+
+// A frame is a header followed by count items, all in network byte order:
+//   header: magic u8, version u8, count u16
+//   item:   op u16, param id u16, value i32
+#define BIN_HEADER    4
+#define BIN_ITEM      8
+#define BIN_MAX_ITEMS 31
+#define BIN_MAX_FRAME (BIN_HEADER + BIN_MAX_ITEMS*BIN_ITEM)
+
+// Item ops.  A reply item carries the request's op, or BIN_ERROR if the
+// op or parameter id was not valid.
+#define BIN_GET   1
+#define BIN_SET   2
+#define BIN_ERROR 0xFFFF
+
+int bin_frame_len (const unsigned char *buf, int len);
+int bin_reply (const unsigned char *frame, unsigned char *reply);
+
+#endif /*BINPROTO_H_*/
@@ -0,0 +1,323 @@
+/*
+ * file:   loadclient.c
+ *
+ * Load generator for the record lookup service (recserve.c) and the
+ * binary parameter frames (binproto.c)
+ *
+ * Opens a number of connections to the thermostat server, each on its
+ * own thread, and sends lookups on every connection one after another,
+ * waiting for each reply before sending the next.  The time from
+ * sending a lookup to having its whole reply is recorded, and the
+ * throughput and latency percentiles over all connections are printed
+ * at the end.
+ *
+ * Usage: loadclient [-s server] [-c conns] [-n requests] [-q file | -i max | -b items]
+ *
+ *   -s server    server address (127.0.0.1)
+ *   -c conns     connections, each on its own thread (1)
+ *   -n requests  lookups per connection (10000)
+ *   -q file      lookups to send, one per line as "id N" or "prefix P",
+ *                used in turn
+ *   -i max       send "id N" for random N below max instead (100000)
+ *   -b items     poll the parameters instead, with binary frames of this
+ *                many gets each, as supervisory software would
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.
+ * If not, see <https://www.gnu.org/licenses/>
+*/
+#include <stdlib.h>
+#include <sys/types.h>
+#include <sys/socket.h>
+#include <stdio.h>
+#include <string.h>
+#include <time.h>
+#include <pthread.h>
+
+#include <netinet/in.h>
+#include <arpa/inet.h>
+#include <unistd.h>
+
+#include "params.h"
+#include "binproto.h"
+
+#define LOCAL "127.0.0.1"
+#define BUFLEN 80
+#define MAX_CONNS 256
+#define REPLY_LEN 8192
+
+typedef struct
+{
+  int id;
+  int requests;
+  double *latency;    // microseconds for each request
+  int done;           // requests answered
+  long records;       // records listed in the replies
+} conn_t;
+
+static char *server = LOCAL;
+static char **queries;
+static int nqueries, max_id = 100000, batch;
+
+static double now_us (void)
+{
+  struct timespec ts;
+
+  clock_gettime (CLOCK_MONOTONIC, &ts);
+  return ts.tv_sec*1e6 + ts.tv_nsec/1e3;
+}
+
+static int connect_server (void)
+{
+  struct sockaddr_in addr;
+  int s = socket (AF_INET, SOCK_STREAM, 0);
+
+  addr.sin_family = AF_INET;
+  addr.sin_port = htons (PORT);
+  if (s < 0 || inet_aton (server, &addr.sin_addr) == 0
+      || connect (s, (struct sockaddr *) &addr, sizeof (addr)) < 0)
+  {
+    perror ("Client can't connect");
+    if (s >= 0)
+      close (s);
+    return -1;
+  }
+  return s;
+}
+
+static int read_reply (int s, char *buf, int *records)
+/*
+    Read one lookup reply: the "SERVER> n of m" line and n record lines.
+    A reply with no count, such as BUSY or an error, is one line and
+    lists no records.  Returns 0, or -1 if the connection closed or the
+    reply is too long.
+*/
+{
+  int len = 0, got, lines = 0, want = -1;
+  char *p;
+
+  while (want < 0 || lines < want + 1)
+  {
+    if (len == REPLY_LEN - 1)
+      return -1;
+    if ((got = read (s, buf + len, REPLY_LEN - 1 - len)) <= 0)
+      return -1;
+    for (p = buf + len; p < buf + len + got; p++)
+      if (*p == '\n')
+        lines++;
+    len += got;
+    buf[len] = '\0';
+    if (want < 0 && lines > 0 && sscanf (buf, "SERVER> %d of", &want) != 1)
+      want = 0;
+  }
+  *records = want;
+  return 0;
+}
+
+static int read_frame (int s, unsigned char *buf, int len)
+/*
+    Read the len byte reply to a frame.  Returns 0, or -1 if the
+    connection closed or the reply is bad.
+*/
+{
+  int have = 0, got, i;
+
+  while (have < len)
+  {
+    if ((got = read (s, buf + have, len - have)) <= 0)
+      return -1;
+    have += got;
+  }
+  if (buf[0] != BIN_MAGIC || buf[1] != BIN_VERSION)
+    return -1;
+  for (i = 0; i < batch; i++)
+    if (buf[BIN_HEADER + i*BIN_ITEM] != 0 || buf[BIN_HEADER + i*BIN_ITEM + 1] != BIN_GET)
+      return -1;
+  return 0;
+}
+
+static void *run_conn (void *arg)
+{
+  conn_t *c = arg;
+  char text[BUFLEN], reply[REPLY_LEN];
+  unsigned char frame[BIN_MAX_FRAME];
+  unsigned int seed = c->id + 1;
+  int s, i, records, len;
+  double start;
+
+  if ((s = connect_server ()) < 0)
+    return NULL;
+
+  // The same frame every time: get each parameter in turn
+  len = BIN_HEADER + batch*BIN_ITEM;
+  frame[0] = BIN_MAGIC;
+  frame[1] = BIN_VERSION;
+  frame[2] = 0;
+  frame[3] = batch;
+  for (i = 0; i < batch; i++)
+  {
+    unsigned char item[BIN_ITEM] = {0, BIN_GET, 0, i % NUM_PARAMS, 0, 0, 0, 0};
+    memcpy (frame + BIN_HEADER + i*BIN_ITEM, item, BIN_ITEM);
+  }
+
+  for (i = 0; i < c->requests; i++)
+  {
+    if (batch > 0)
+    {
+      start = now_us ();
+      if (write (s, frame, len) != len || read_frame (s, (unsigned char *) reply, len) != 0)
+      {
+        fprintf (stderr, "connection %d: frame %d failed\n", c->id, i);
+        break;
+      }
+      c->latency[c->done++] = now_us () - start;
+      c->records += batch;
+      continue;
+    }
+    if (nqueries > 0)
+      len = snprintf (text, BUFLEN, "%s\n", queries[(c->id + i) % nqueries]);
+    else
+      len = snprintf (text, BUFLEN, "id %d\n", rand_r (&seed) % max_id);
+    start = now_us ();
+    if (write (s, text, len) != len || read_reply (s, reply, &records) != 0)
+    {
+      fprintf (stderr, "connection %d: lookup %d failed\n", c->id, i);
+      break;
+    }
+    c->latency[c->done++] = now_us () - start;
+    c->records += records;
+  }
+  write (s, "q\n", 2);
+  close (s);
+  return NULL;
+}
+
+static int load_queries (char *filename)
+{
+  FILE *file = fopen (filename, "r");
+  char line[BUFLEN];
+  int cap = 0;
+
+  if (file == NULL)
+    return -1;
+  while (fgets (line, BUFLEN, file))
+  {
+    line[strcspn (line, "\r\n")] = '\0';
+    if (line[0] == '\0')
+      continue;
+    if (nqueries == cap)
+    {
+      cap = cap ? 2*cap : 1024;
+      if ((queries = realloc (queries, cap*sizeof (char *))) == NULL)
+        return -1;
+    }
+    queries[nqueries++] = strdup (line);
+  }
+  fclose (file);
+  return nqueries > 0 ? 0 : -1;
+}
+
+static int cmp_double (const void *a, const void *b)
+{
+  double x = *(const double *) a, y = *(const double *) b;
+
+  return (x > y) - (x < y);
+}
+
+int main (int argc, char *argv[])
+{
+  conn_t conns[MAX_CONNS];
+  pthread_t threads[MAX_CONNS];
+  int opt, i, nconns = 1, requests = 10000, total = 0;
+  long records = 0;
+  double start, elapsed, *all;
+
+  while ((opt = getopt (argc, argv, "s:c:n:q:i:b:")) != -1)
+  {
+    switch (opt)
+    {
+      case 's': server = optarg;
+        break;
+      case 'c': nconns = atoi (optarg);
+        break;
+      case 'n': requests = atoi (optarg);
+        break;
+      case 'q':
+        if (load_queries (optarg) != 0)
+        {
+          printf ("Couldn't read queries from %s\n", optarg);
+          exit (1);
+        }
+        break;
+      case 'i': max_id = atoi (optarg);
+        break;
+      case 'b': batch = atoi (optarg);
+        break;
+      default:
+        printf ("Usage: %s [-s server] [-c conns] [-n requests] [-q file | -i max | -b items]\n", argv[0]);
+        exit (2);
+    }
+  }
+  if (nconns < 1 || nconns > MAX_CONNS || requests < 1 || max_id < 1
+      || batch < 0 || batch > BIN_MAX_ITEMS)
+  {
+    printf ("conns must be 1 to %d, items 1 to %d, requests and max at least 1\n",
+            MAX_CONNS, BIN_MAX_ITEMS);
+    exit (2);
+  }
+
+  for (i = 0; i < nconns; i++)
+  {
+    conns[i].id = i;
+    conns[i].requests = requests;
+    conns[i].done = 0;
+    conns[i].records = 0;
+    if ((conns[i].latency = malloc (requests*sizeof (double))) == NULL)
+    {
+      printf ("Out of memory\n");
+      exit (1);
+    }
+  }
+  start = now_us ();
+  for (i = 0; i < nconns; i++)
+    pthread_create (&threads[i], NULL, run_conn, &conns[i]);
+  for (i = 0; i < nconns; i++)
+    pthread_join (threads[i], NULL);
+  elapsed = now_us () - start;
+
+  // Percentiles over every answered request
+  if ((all = malloc ((long) nconns*requests*sizeof (double))) == NULL)
+  {
+    printf ("Out of memory\n");
+    exit (1);
+  }
+  for (i = 0; i < nconns; i++)
+  {
+    memcpy (all + total, conns[i].latency, conns[i].done*sizeof (double));
+    total += conns[i].done;
+    records += conns[i].records;
+  }
+  if (total == 0)
+  {
+    printf ("No %s answered\n", batch ? "frames" : "lookups");
+    exit (1);
+  }
+  qsort (all, total, sizeof (double), cmp_double);
+  printf ("%d %s on %d connections in %.3f s: %.0f %s/s, %ld %s\n",
+          total, batch ? "frames" : "lookups", nconns, elapsed/1e6, total/(elapsed/1e6),
+          batch ? "frames" : "lookups", records, batch ? "values" : "records");
+  printf ("latency us: min %.1f  p50 %.1f  p90 %.1f  p99 %.1f  max %.1f\n",
+          all[0], all[total/2], all[(long) total*9/10], all[(long) total*99/100],
+          all[total - 1]);
+  return total == nconns*requests ? 0 : 1;
+}
@@ -23,6 +23,16 @@
  * "s #" : set the setpoint to new value #
  * "l #" : set the limit to new value #
  * "d #" : set the deadband to new value #
+ *
+ * When the thermostat is started with a record file, records can be
+ * looked up with (see recserve.c):
+ *
+ * "id #"     : records with ID #
+ * "prefix P" : records whose name starts with P
+ *
+ * Programs polling the parameters can send binary frames instead, on
+ * the same connection; they start with a byte no command does, and
+ * carry batches of gets and sets (see binproto.c).
  *     
  * This program is free software: you can redistribute it and/or modify
  * it under the terms of the GNU General Public License as published by
@@ -51,6 +61,9 @@
 #include <arpa/inet.h>
 
 #include "thermostat.h"
+#include "recserve.h"
+#include "params.h"
+#include "binproto.h"
 
 const char *delims = " \t,=\n";
 
@@ -109,14 +122,107 @@ int createServer()
 // createServer function: End
 //==============================================================================
 
-pthread_mutex_t paramMutex;
 pthread_t monitorT;
 
+static int serve_frames (int client_socket, char *text, int *len)
+/*
+    Answer the binary frames at the start of the len bytes in text,
+    reading the rest of any frame that has only partly arrived.  Text
+    left after the frames is moved to the start of text and its length
+    put in len.  Returns 0, or -1 if the connection closed or a frame
+    was bad.
+*/
+{
+  unsigned char buf[BIN_MAX_FRAME], reply[BIN_MAX_FRAME];
+  int have = *len, need, got;
+
+  memcpy (buf, text, have);
+  while (have > 0 && buf[0] == BIN_MAGIC)
+  {
+    // Read no further than this frame, so what follows stays in the socket
+    while ((need = bin_frame_len (buf, have)) == 0 || need > have)
+    {
+      got = read (client_socket, buf + have, (need ? need : BIN_HEADER) - have);
+      if (got <= 0)
+        return -1;
+      have += got;
+    }
+    if (need < 0)
+    {
+      printf ("Bad frame from client\n");
+      return -1;
+    }
+    write (client_socket, reply, bin_reply (buf, reply));
+    have -= need;
+    memmove (buf, buf + need, have);
+  }
+  memcpy (text, buf, have);
+  *len = have;
+  return 0;
+}
+
+static void serve_commands (int client_socket, char *text)
+/*
+    Answer the text commands in text, a NUL-terminated line
+*/
+{
+  char *cmd, text2[BUFLEN], reply[REPLY_LEN], *query_param = NULL, *new_value = NULL;
+  int len, id;
+
+  cmd = strtok (text, delims);
+
+  while (cmd)
+  {
+    if (is_lookup (cmd))
+    {
+      // The record indexes are read-only, so no mutex here
+      len = lookup_reply (cmd, strtok (NULL, delims), reply, REPLY_LEN);
+      write (client_socket, reply, len);
+      cmd = strtok (NULL, delims);
+      continue;
+    }
+    if(*cmd == '?')
+    {
+      query_param = strtok (NULL, delims);
+    }
+    else
+    {
+      new_value = strtok (NULL, delims);
+    }
+    // The parameters are set and read through the seqlock in params.c,
+    // which never blocks; the reply is written afterwards
+    len = 0;
+    switch (*cmd)
+    {
+      case 's':
+      case 'l':
+      case 'd':
+        if (new_value == NULL)
+          break;
+        params_set (param_id (*cmd), atoi (new_value));
+        len = sprintf (text2, "SERVER> OK");
+        break;
+
+      case '?':
+        // Third character is thermostat query parameter
+        if (query_param != NULL && (id = param_id (*query_param)) >= 0)
+          len = sprintf (text2, "SERVER> %d", params_get_one (id));
+        break;
+
+      default:
+        break;
+    }
+    if (len > 0)
+      write (client_socket, text2, len);
+    
+    cmd = strtok (NULL, delims);
+  }
+}
+
 void *monitor (void *arg)
 {
-  char text[BUFLEN], *cmd, text2[BUFLEN], *query_param;
-  unsigned int value1;
-  // int len;
+  char text[BUFLEN], line[BUFLEN], *nl;
+  int len = 0, got, line_len;
 
   int client_socket = createServer();
   if(client_socket  == -1)
@@ -128,83 +234,51 @@ void *monitor (void *arg)
   while (1)
   {
       // fgets (text, BUFLEN, stdin);
-    read (client_socket, &text, BUFLEN);
-
-    cmd = strtok (text, delims);
+    // An unfinished line from the last read is still at the start of text
+    got = read (client_socket, text + len, BUFLEN - 1 - len);
+    if (got <= 0)
+      break;
+    len += got;
 
-    while (cmd)
+    // One read can hold commands and frames back to back, so take a
+    // line at a time and look for a frame after each one
+    while (len > 0)
     {
-      if(*cmd == '?')
-      {
-        query_param = strtok (NULL, delims);
-      }
-      else
-      {
-        value1 = atoi (strtok (NULL, delims));
-      }
-      pthread_mutex_lock (&paramMutex);   //get exclusive access to parameters 
-      switch (*cmd)
+      if ((unsigned char) text[0] == BIN_MAGIC)
       {
-         case 's':
-              setpoint = value1;
-              write (client_socket, "SERVER> OK", 10);
-              break;
-              
-          case 'l':
-              limit = value1;
-              write (client_socket, "SERVER> OK", 10);
-              break;
-              
-          case 'd':
-              deadband = value1;
-              write (client_socket, "SERVER> OK", 10);
-              break;
-              
-          case '?':
-            switch (*query_param) // Third character is thermostat  query paramter
-            {
-              // Considering setpoint, limit, deadband, temp to be 3
-              // digit maximum
-              case 's':
-                  sprintf (text2, "SERVER> %d", setpoint);
-                  write (client_socket, text2, strlen (text2));
-                break;
-              case 'l':
-                  sprintf (text2, "SERVER> %d", limit);
-                  write (client_socket, text2, strlen (text2));
-                break;
-              case 'd':
-                  sprintf (text2, "SERVER> %d", deadband);
-                  write (client_socket, text2, strlen (text2));
-                break;
-              case 't':
-                  sprintf (text2, "SERVER> %d", value);
-                  write (client_socket, text2, strlen (text2));
-                break;
+        if (serve_frames (client_socket, text, &len) != 0)
+        {
+          len = -1;
+          break;
         }
-        break;
-          
-        default:
-            break;
+        continue;
       }
-      pthread_mutex_unlock (&paramMutex);     // release the parameters
-      
-      cmd = strtok (NULL, delims);
+      if ((nl = memchr (text, '\n', len)) != NULL)
+        line_len = nl - text + 1;
+      else if (len == BUFLEN - 1)
+        line_len = len;     // a line too long for the buffer is taken as it is
+      else
+        break;              // wait for the rest of the line
+      memcpy (line, text, line_len);
+      line[line_len] = '\0';
+      len -= line_len;
+      memmove (text, text + line_len, len);
+      serve_commands (client_socket, line);
     }
+    if (len < 0)
+      break;
   }
+  close (client_socket);
   return NULL;
 }
 
 /*
-    Creates the mutex and starts up the monitor thread
+    Starts up the monitor thread
     Create the Posix objects
 */
 int createThread ()
 {
   int error;
-  error = pthread_mutex_init (&paramMutex, NULL);
-  CHECK_ERROR;
-  
   error = pthread_create (&monitorT, NULL, monitor, NULL);
   CHECK_ERROR;
   
@@ -1,352 +1,793 @@
-/*
- * multimon.c
- *
- * Created on: May 23, 2020
- * Author: pratik yadav
- * 
- * A Posix thread to monitor console input for parameter changes
- * Also includes functions to create and terminate the thread called
- * from main() in the thermostat.c file
- * 
- * Server is created to respond to the thermostat parameter queries. Client can
- * use the following query commands to request thermostat parameters from the
- * server:
- * 
- * "? s" : Thermostat setpoint.
- * "? l" : Thermostat limit.
- * "? d" : Thermostat deadband.
- * "? t" : Thermostat temperature.
- * 
- * The client can also set the following parameter with these commands:
- * 
- * "s #" : set the setpoint to new value #
- * "l #" : set the limit to new value #
- * "d #" : set the deadband to new value #
- * "q"   : close socket 
- *
- * There are resources to support multiple monitor servers. 
- *
- * This program is free software: you can redistribute it and/or modify
- * it under the terms of the GNU General Public License as published by
- * the Free Software Foundation, either version 3 of the License, or
- * (at your option) any later version.
- *
- * This program is distributed in the hope that it will be useful,
- * but WITHOUT ANY WARRANTY; without even the implied warranty of
- * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
- * GNU General Public License for more details.
- *
- * You should have received a copy of the GNU General Public License
- * along with this program.  
- * If not, see <https://www.gnu.org/licenses/> 
- */
-#include <stdio.h>
-#include <stdlib.h>
-#include <sys/types.h>
-#include <string.h>
-#include <unistd.h>
-#include <signal.h>
-#include <pthread.h>
-
-#include <sys/socket.h>
-#include <netinet/in.h>
-#include <arpa/inet.h>
-
-#include "thermostat.h"
-
-#define BUFLEN 80
-#define NUM_THREADS 10
-
-typedef enum
-{
-  FREE,
-  IN_USE,
-  PENDING
-}used; // monitor thread status flag
-
-typedef struct
-{
-  used flag;
-  int socket;
-  pthread_t *thread;
-} meta_pthread_t;
-
-// Threads
-pthread_t createServerT;
-pthread_t monitorT[NUM_THREADS];
-pthread_t resourceT;
-
-// Mutexes
-pthread_mutex_t paramMutex;
-pthread_mutex_t paramMutex2;
-
-meta_pthread_t mon_thread_data[NUM_THREADS];
-//==============================================================================
-// resource function
-//==============================================================================
-void *resource(void *arg)
-{
-	meta_pthread_t *p_mon_thread_data;
-	void *thread_val;
-	int i;
-	while(1)
-	{
-		// pthread_mutex_lock (&paramMutex2);   //get exclusive access to parameters
-	    // Get the monitor threads meta data
-		p_mon_thread_data = (meta_pthread_t*)arg;
-	    // Check for monitor threads with pending flags
-		for(i=0; i<NUM_THREADS; i++)
-		{
-			if (p_mon_thread_data[i].flag == PENDING)
-			{
-				// Cancel the corresponding monitor thread
-				pthread_cancel (*(p_mon_thread_data[i].thread));
-				// Join the corresponding monitor thread
-				pthread_join (*(p_mon_thread_data[i].thread), &thread_val);
-			    // Change the pending flag to free
-				p_mon_thread_data[i].flag = FREE;
-				printf("Flags free\n");
-			}
-		}
-    // pthread_mutex_unlock (&paramMutex2);   // release the parameters
-    // Sleep
-    sleep(5);
-	}
-	return NULL;
-}
-//==============================================================================
-// resource function: End
-//==============================================================================
-
-//==============================================================================
-// monitor function
-//==============================================================================
-void *monitor (void *arg)
-{
-  char text[BUFLEN], text2[BUFLEN], *cmd, *cmd2,*query_param;
-  unsigned int value1;
-  const char *delims = " \t,=\n";
-  int write_status, read_status;
-  // int len;
-
-  meta_pthread_t *p_mon_thread_data;
-  p_mon_thread_data = (meta_pthread_t *)arg;
-  while (1)
-  {
-    // fgets (text, BUFLEN, stdin);
-    read_status = read (p_mon_thread_data->socket, &text, BUFLEN);
-    if (read_status < 0)
-        perror ("read");
-    else
-    {
-      printf("%s", text);
-      cmd = strtok (text, delims);
-      printf("%s\n", cmd);
-      while (cmd)
-      {
-          // value1 = atoi (strtok (NULL, delims));
-          // This step was casuing segmentation fault, I commented it out for
-          // debugging purposes. using raw value to parse the command
-          if(*cmd == '?')
-          {
-              query_param = strtok (NULL, delims);
-              printf("%s\n", query_param);
-          }
-          else if(*cmd == 'q')
-          {
-              printf("Client is terminating.\n");
-          }
-          else
-          {
-              cmd2 = strtok (NULL, delims);
-              value1 = atoi (cmd2);
-              printf("%s\n", cmd2);
-          }
-          pthread_mutex_lock (&paramMutex); //get exclusive access to parameters
-          switch (*cmd)
-          {
-            case 's':
-                setpoint = value1;
-                printf("Socket in monitor task: %d\n", p_mon_thread_data->socket);
-                write_status = write (p_mon_thread_data->socket, "SERVER> OK", 10);
-                if(write_status<0)
-                    perror("write");
-                printf("write status: %d\n", write_status);
-                break;
-            case 'l':
-                limit = value1;
-                write (p_mon_thread_data->socket, "SERVER> OK", 10);
-                break;
-            case 'd':
-                deadband = value1;
-                write (p_mon_thread_data->socket, "SERVER> OK", 10);
-                break;
-            case 'q':
-                // pthread_mutex_lock (&paramMutex2);   //get exclusive access to parameters
-                p_mon_thread_data->flag = PENDING;
-                close(p_mon_thread_data->socket);
-                pthread_mutex_unlock (&paramMutex);     // release the parameters
-                return NULL;
-                // pthread_cancel (*(p_mon_thread_data->thread));
-                // exit(1); // Terminate and exit the running monitor thread
-                // pthread_mutex_unlock (&paramMutex2);   // release the parameters
-                break;
-            case '?':
-                switch (*query_param) // Third character is thermostat  query paramter
-                {
-                  case 's':
-                      sprintf (text2, "SERVER> %d", setpoint);
-                      write (p_mon_thread_data->socket, text2, strlen (text2));
-                      break;
-                  case 'l':
-                      sprintf (text2, "SERVER> %d", limit);
-                      write (p_mon_thread_data->socket, text2, strlen (text2));
-                      break;
-                  case 'd':
-                      sprintf (text2, "SERVER> %d", deadband);
-                      write (p_mon_thread_data->socket, text2, strlen (text2));
-                      break;
-                  case 't':
-                      sprintf (text2, "SERVER> %d", value);
-                      write (p_mon_thread_data->socket, text2, strlen (text2));
-                      break;
-                }
-                break;
-                
-            default:
-                break;
-          }
-          pthread_mutex_unlock (&paramMutex);     // release the parameters
-
-          cmd = strtok (NULL, delims);
-
-          sleep(1);
-      }
-    }
-  }
-  return NULL;
-}
-//==============================================================================
-// monitor function: End
-//==============================================================================
-
-//==============================================================================
-// createServer funtion: Assignment 5
-//==============================================================================
-void *createServer(void *arg)
-{
-  int server_socket, client_len;
-  struct sockaddr_in server_addr, client_addr;
-  int result;
-  int iter = 0;
-
-  int j;
-  for (j=0; j<NUM_THREADS; j++)
-  {
-    mon_thread_data[j].flag = 0;
-    mon_thread_data[j].socket = 0;
-    mon_thread_data[j].thread = 0;
-  }
-
-  // Create unnamed socket and give it a "name"
-  server_socket = socket (PF_INET, SOCK_STREAM, 0);
-  server_addr.sin_family = AF_INET;
-  result = inet_aton (SERVER, &server_addr.sin_addr);
-  if (result == 0)
-  {
-    printf ("inet_aton failed\n");
-    // exit (1);
-    return NULL;
-  }
-  server_addr.sin_port = htons (PORT);
-
-  // Bind to the socket
-  result = bind (server_socket, (struct sockaddr *) &server_addr, sizeof (server_addr));
-  if (result != 0)
-  {
-    perror ("bind");
-    // exit (1);
-    return NULL;
-  }
-
-  // Create a client queue
-  result = listen (server_socket, 1);
-  if (result != 0)
-  {
-    perror ("listen");
-    // exit (1);
-    return NULL;
-  }
-  printf ("Network server running\n");
-
-  // Accept a connection
-  while(1)
-  {
-    // pthread_mutex_lock (&paramMutex2);   //get exclusive access to parameters
-    client_len = sizeof (client_addr);
-    mon_thread_data[iter].socket = accept (server_socket, (struct sockaddr *) &client_addr, (socklen_t * __restrict__)&client_len);
-
-    printf ("Connection established to %s\n", inet_ntoa (client_addr.sin_addr));
-    printf ("socket in create server task: %d\n", mon_thread_data[iter].socket);
-    // Populate the monitor thread meta data
-    mon_thread_data[iter].flag = IN_USE;
-    mon_thread_data[iter].thread = &monitorT[iter];
-    // pthread_mutex_unlock (&paramMutex2);   // release the parameters
-    // Create monitor thread
-    result = pthread_create (&monitorT[iter], NULL, monitor, (void *)&mon_thread_data[iter]);
-    iter++;
-    printf("iter's new value: %d\n",iter);
-    if(iter==NUM_THREADS)
-    {
-      iter = 0;
-      printf("Maximum clients reached, restarting from 0\n");
-    }
-  }
-  return NULL;
-}
-//==============================================================================
-// createServer function: End
-//==============================================================================
-
-#define CHECK_ERROR if (error) { \
-        printf ("%s\n", strerror (error)); \
-        return 1; }
-
-/*
-    Creates the mutex and starts up the create server thread
-    Create the Posix objects
-*/
-int createThread ()
-{
-  int error;
-  // Init mutex for setpoint, deadband and limit
-  error = pthread_mutex_init (&paramMutex, NULL);
-  CHECK_ERROR;
-  // init mutex for monitor threads meta data
-  error = pthread_mutex_init (&paramMutex2, NULL);
-  CHECK_ERROR;
-  // Create server thread
-  error = pthread_create (&createServerT, NULL, createServer, NULL);
-  CHECK_ERROR;
-  // Resource thread
-  error = pthread_create (&resourceT, NULL, resource, (void *)&mon_thread_data);
-  CHECK_ERROR;
-
-  return 0;
-}
-
-/*
-    Cancel and join the createServerT thread
-*/
-void terminateThread (void)
-{
-	void *thread_val;
-  // Terminate createServer thread
-  pthread_cancel (createServerT);
-  pthread_join (createServerT, &thread_val); // This was monitorT
-  // Terminate resource thread
-  pthread_cancel (resourceT);
-  pthread_join (resourceT, &thread_val); // This was monitorT
-}
-
-
+/*
+ * multimon.c
+ *
+ * Created on: May 23, 2020
+ * Author: pratik yadav
+ * 
+ * A Posix thread to monitor console input for parameter changes
+ * Also includes functions to create and terminate the thread called
+ * from main() in the thermostat.c file
+ * 
+ * Server is created to respond to the thermostat parameter queries. Client can
+ * use the following query commands to request thermostat parameters from the
+ * server:
+ * 
+ * "? s" : Thermostat setpoint.
+ * "? l" : Thermostat limit.
+ * "? d" : Thermostat deadband.
+ * "? t" : Thermostat temperature.
+ * 
+ * The client can also set the following parameter with these commands:
+ * 
+ * "s #" : set the setpoint to new value #
+ * "l #" : set the limit to new value #
+ * "d #" : set the deadband to new value #
+ * "q"   : close socket 
+ * "id #"     : records with ID #, when a record file was loaded
+ * "prefix P" : records whose name starts with P
+ *
+ * Programs polling the parameters can send binary frames instead, on
+ * the same connection; they start with a byte no command does, and
+ * carry batches of gets and sets (see binproto.c).
+ *
+ * Any number of clients are served by one I/O thread running an epoll
+ * event loop.  Sockets are non-blocking, and each connection has its
+ * own input buffer, where commands are collected until a full line has
+ * arrived, and an output buffer that only exists while a reply is
+ * waiting for the client to read it.  An idle connection costs a few
+ * hundred bytes rather than a thread.
+ *
+ * The commands themselves are carried out by a pool of worker threads,
+ * one per core, started once with the server.  The I/O thread hands
+ * each complete command line to the workers through a bounded lock-free
+ * queue and gets the finished replies back through a second one, woken
+ * by an eventfd; only the I/O thread ever touches a connection.  A
+ * connection has at most one line with the workers at a time, so its
+ * replies come back in order, and further lines wait in its input
+ * buffer, which stops being read once full.
+ *
+ * Backpressure: at most QUEUE_LEN lines are with the workers at once.
+ * A line that arrives when they are all taken is not queued; the client
+ * gets "SERVER> BUSY" for it straight away and may send it again.
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  
+ * If not, see <https://www.gnu.org/licenses/> 
+ */
+#define _GNU_SOURCE
+#include <stdio.h>
+#include <stdlib.h>
+#include <stdint.h>
+#include <sys/types.h>
+#include <string.h>
+#include <unistd.h>
+#include <signal.h>
+#include <errno.h>
+#include <sched.h>
+#include <pthread.h>
+#include <semaphore.h>
+#include <stdatomic.h>
+
+#include <sys/socket.h>
+#include <sys/epoll.h>
+#include <sys/eventfd.h>
+#include <netinet/in.h>
+#include <arpa/inet.h>
+
+#include "thermostat.h"
+#include "recserve.h"
+#include "params.h"
+#include "binproto.h"
+
+#define BUFLEN 80
+#define IN_LEN 256          // longest command line; holds a BIN_MAX_FRAME frame
+#define MAX_OUT (1 << 20)   // unread replies before a client is dropped
+#define MAX_EVENTS 64
+#define QUEUE_LEN 256       // lines with the workers at once, a power of 2
+#define MAX_WORKERS 64
+#define ACCEPT_RETRY_MS 1000  // accepting paused for lack of descriptors
+
+typedef struct conn
+{
+  int socket;
+  char in[IN_LEN];    // command text not yet parsed
+  int in_len;
+  char *out;          // replies the client hasn't read yet, or NULL
+  int out_len, out_cap;
+  int busy;           // a line is with the workers
+  int paused;         // input buffer full, not reading
+  int closing;        // close once the current event is handled
+  int closed;         // socket closed, freed when no longer busy
+  struct conn *dead;  // next closed connection to free
+} conn_t;
+
+typedef struct job
+{
+  conn_t *conn;
+  char line[IN_LEN];
+  char reply[2*REPLY_LEN];
+  int reply_len;
+  int quit;           // the line ended with "q"
+  struct job *next;   // free list
+} job_t;
+
+// Bounded multi-producer multi-consumer queue of jobs.  Each cell's
+// sequence number says whether it is ready to be filled or emptied for
+// the current lap, so pushes and pops only contend on one counter each.
+typedef struct
+{
+  _Atomic size_t seq;
+  job_t *job;
+} cell_t;
+
+typedef struct
+{
+  cell_t cells[QUEUE_LEN];
+  _Atomic size_t head __attribute__ ((aligned (64)));
+  _Atomic size_t tail __attribute__ ((aligned (64)));
+} ring_t;
+
+// Threads
+pthread_t createServerT;
+pthread_t workerT[MAX_WORKERS];
+static int nworkers;
+
+static int epfd, wakefd, listen_socket;
+static int nconns;
+static int accept_paused;   // out of descriptors; listening socket not watched
+static conn_t *dead_conns;  // freed after each batch of events
+
+static ring_t work_q, done_q;
+static sem_t work_ready;
+static job_t jobs[QUEUE_LEN];
+static job_t *free_jobs;    // owned by the I/O thread; empty means busy
+static int wake_marker;     // epoll data for wakefd
+
+//==============================================================================
+// Queue functions
+//==============================================================================
+static void ring_init (ring_t *r)
+{
+  size_t i;
+
+  for (i = 0; i < QUEUE_LEN; i++)
+    atomic_init (&r->cells[i].seq, i);
+  atomic_init (&r->head, 0);
+  atomic_init (&r->tail, 0);
+}
+
+static int ring_push (ring_t *r, job_t *job)
+/*
+    Add job to the queue.  Returns 0, or -1 if it is full.
+*/
+{
+  size_t pos = atomic_load_explicit (&r->tail, memory_order_relaxed);
+  cell_t *cell;
+  intptr_t dif;
+
+  while (1)
+  {
+    cell = &r->cells[pos & (QUEUE_LEN - 1)];
+    dif = (intptr_t) atomic_load_explicit (&cell->seq, memory_order_acquire) - (intptr_t) pos;
+    if (dif == 0)
+    {
+      if (atomic_compare_exchange_weak_explicit (&r->tail, &pos, pos + 1,
+                                                 memory_order_relaxed, memory_order_relaxed))
+        break;
+    }
+    else if (dif < 0)
+      return -1;
+    else
+      pos = atomic_load_explicit (&r->tail, memory_order_relaxed);
+  }
+  cell->job = job;
+  atomic_store_explicit (&cell->seq, pos + 1, memory_order_release);
+  return 0;
+}
+
+static job_t *ring_pop (ring_t *r)
+/*
+    Take the oldest job from the queue, or NULL if it is empty
+*/
+{
+  size_t pos = atomic_load_explicit (&r->head, memory_order_relaxed);
+  cell_t *cell;
+  job_t *job;
+  intptr_t dif;
+
+  while (1)
+  {
+    cell = &r->cells[pos & (QUEUE_LEN - 1)];
+    dif = (intptr_t) atomic_load_explicit (&cell->seq, memory_order_acquire) - (intptr_t) (pos + 1);
+    if (dif == 0)
+    {
+      if (atomic_compare_exchange_weak_explicit (&r->head, &pos, pos + 1,
+                                                 memory_order_relaxed, memory_order_relaxed))
+        break;
+    }
+    else if (dif < 0)
+      return NULL;
+    else
+      pos = atomic_load_explicit (&r->head, memory_order_relaxed);
+  }
+  job = cell->job;
+  atomic_store_explicit (&cell->seq, pos + QUEUE_LEN, memory_order_release);
+  return job;
+}
+//==============================================================================
+// Queue functions: End
+//==============================================================================
+
+//==============================================================================
+// monitor function
+//==============================================================================
+static void monitor (job_t *job)
+/*
+    Carry out the commands on one line from a client, collecting the
+    replies in the job.  Runs on a worker thread.
+*/
+{
+  char *cmd, *arg, *save, *reply;
+  const char *delims = " \t,=\r\n";
+  int room, id;
+
+  job->reply_len = 0;
+  job->quit = 0;
+  cmd = strtok_r (job->line, delims, &save);
+  while (cmd)
+  {
+    arg = strtok_r (NULL, delims, &save);
+    reply = job->reply + job->reply_len;
+    room = sizeof (job->reply) - job->reply_len;
+    if (room < BUFLEN)
+      break;
+    if (is_lookup (cmd))
+    {
+      // The record indexes are read-only, so no mutex here
+      job->reply_len += lookup_reply (cmd, arg, reply, room);
+      cmd = strtok_r (NULL, delims, &save);
+      continue;
+    }
+    if (*cmd == 'q')
+    {
+      job->quit = 1;
+      return;
+    }
+
+    // The parameters go through the seqlock in params.c, so a worker
+    // never waits on the control loop or on another worker here
+    switch (*cmd)
+    {
+      case 's':
+      case 'l':
+      case 'd':
+        if (arg == NULL)
+          break;
+        params_set (param_id (*cmd), atoi (arg));
+        job->reply_len += sprintf (reply, "SERVER> OK");
+        break;
+      case '?':
+        // thermostat query parameter
+        if (arg == NULL || (id = param_id (*arg)) < 0)
+          break;
+        job->reply_len += sprintf (reply, "SERVER> %d", params_get_one (id));
+        break;
+
+      default:
+        break;
+    }
+
+    cmd = strtok_r (NULL, delims, &save);
+  }
+}
+//==============================================================================
+// monitor function: End
+//==============================================================================
+
+//==============================================================================
+// worker function
+//==============================================================================
+void *worker (void *arg)
+{
+  job_t *job;
+  uint64_t one = 1;
+
+  while (1)
+  {
+    // A signal handler (SIGINT in thermostat.c) interrupts sem_wait
+    // without taking a token, so wait again rather than pop a job that
+    // belongs to another worker
+    while (sem_wait (&work_ready) != 0 && errno == EINTR)
+      ;
+    // The semaphore counts queued jobs, so there is one for us
+    while ((job = ring_pop (&work_q)) == NULL)
+      sched_yield ();
+    monitor (job);
+    // Never full: it has room for every job there is
+    ring_push (&done_q, job);
+    write (wakefd, &one, sizeof (one));
+  }
+  return NULL;
+}
+//==============================================================================
+// worker function: End
+//==============================================================================
+
+//==============================================================================
+// Connection functions
+//==============================================================================
+static void pause_accept (int pause)
+/*
+    Stop or start watching the listening socket.  With no descriptors
+    left it stays readable, and level-triggered epoll would report it on
+    every wait.
+*/
+{
+  struct epoll_event ev;
+
+  ev.events = pause ? 0 : EPOLLIN;
+  ev.data.ptr = NULL;
+  if (epoll_ctl (epfd, EPOLL_CTL_MOD, listen_socket, &ev) == 0)
+    accept_paused = pause;
+}
+
+static void set_events (conn_t *c)
+{
+  struct epoll_event ev;
+
+  ev.events = (c->paused ? 0 : EPOLLIN) | (c->out_len ? EPOLLOUT : 0);
+  ev.data.ptr = c;
+  epoll_ctl (epfd, EPOLL_CTL_MOD, c->socket, &ev);
+}
+
+static void close_conn (conn_t *c)
+/*
+    Close the socket at once.  c itself is freed after the current batch
+    of events, which may still name it, and not before its line is back
+    from the workers.
+*/
+{
+  if (!c->closed)
+  {
+    epoll_ctl (epfd, EPOLL_CTL_DEL, c->socket, NULL);
+    close (c->socket);
+    free (c->out);
+    c->out = NULL;
+    c->closed = 1;
+    nconns--;
+    // A descriptor is free again
+    if (accept_paused)
+      pause_accept (0);
+  }
+  if (!c->busy)
+  {
+    c->dead = dead_conns;
+    dead_conns = c;
+  }
+}
+
+static void conn_reply (conn_t *c, const char *text, int len)
+/*
+    Send text to the client, keeping what the socket won't take now
+*/
+{
+  int sent = 0, was_empty = c->out_len == 0;
+  char *grown;
+
+  if (c->closing || len == 0)
+    return;
+  if (c->out_len == 0)
+  {
+    sent = send (c->socket, text, len, MSG_NOSIGNAL);
+    if (sent < 0 && errno != EAGAIN && errno != EWOULDBLOCK)
+    {
+      c->closing = 1;
+      return;
+    }
+    if (sent < 0)
+      sent = 0;
+    if (sent == len)
+      return;
+  }
+
+  if (c->out_len + len - sent > MAX_OUT)
+  {
+    printf ("Client isn't reading its replies, closing\n");
+    c->closing = 1;
+    return;
+  }
+  if (c->out_len + len - sent > c->out_cap)
+  {
+    int cap = c->out_cap ? c->out_cap : 1024;
+    while (cap < c->out_len + len - sent)
+      cap *= 2;
+    if ((grown = realloc (c->out, cap)) == NULL)
+    {
+      c->closing = 1;
+      return;
+    }
+    c->out = grown;
+    c->out_cap = cap;
+  }
+  memcpy (c->out + c->out_len, text + sent, len - sent);
+  c->out_len += len - sent;
+  if (was_empty)
+    set_events (c);
+}
+
+static void flush_conn (conn_t *c)
+/*
+    Send what is waiting now that the socket has room
+*/
+{
+  int sent = send (c->socket, c->out, c->out_len, MSG_NOSIGNAL);
+
+  if (sent < 0)
+  {
+    if (errno != EAGAIN && errno != EWOULDBLOCK)
+      c->closing = 1;
+    return;
+  }
+  c->out_len -= sent;
+  memmove (c->out, c->out + sent, c->out_len);
+  if (c->out_len == 0)
+  {
+    // Give the buffer back so idle clients stay small
+    free (c->out);
+    c->out = NULL;
+    c->out_cap = 0;
+    set_events (c);
+  }
+}
+
+static void dispatch (conn_t *c)
+/*
+    Hand the next complete line to the workers, unless one is already
+    with them.  Lines that find the queue full are answered BUSY.
+    Binary frames are answered here.
+*/
+{
+  char *nl;
+  unsigned char frame_reply[BIN_MAX_FRAME];
+  int len;
+  job_t *job;
+
+  while (!c->busy && !c->closing && c->in_len > 0)
+  {
+    if ((unsigned char) c->in[0] == BIN_MAGIC)
+    {
+      // A frame is a few atomic loads and stores through params.c, less
+      // work than handing it to a worker, so the I/O thread answers it.
+      // It still waits for any line before it to come back, for order.
+      if ((len = bin_frame_len ((unsigned char *) c->in, c->in_len)) < 0)
+      {
+        printf ("Bad frame from client, closing\n");
+        c->closing = 1;
+        break;
+      }
+      if (len == 0 || len > c->in_len)
+        break;
+      conn_reply (c, (char *) frame_reply, bin_reply ((unsigned char *) c->in, frame_reply));
+      c->in_len -= len;
+      memmove (c->in, c->in + len, c->in_len);
+      continue;
+    }
+
+    if ((nl = memchr (c->in, '\n', c->in_len)) != NULL)
+      len = nl + 1 - c->in;
+    else if (c->in_len == IN_LEN - 1)
+      len = c->in_len;      // a line too long for the buffer is taken as it is
+    else
+      break;
+
+    if ((job = free_jobs) == NULL)
+      conn_reply (c, "SERVER> BUSY\n", 13);
+    else
+    {
+      free_jobs = job->next;
+      memcpy (job->line, c->in, len);
+      job->line[len] = '\0';
+      job->conn = c;
+      c->busy = 1;
+      ring_push (&work_q, job);
+      sem_post (&work_ready);
+    }
+    c->in_len -= len;
+    memmove (c->in, c->in + len, c->in_len);
+  }
+
+  // Read again once the buffer has room
+  if (c->paused && c->in_len < IN_LEN - 1 && !c->closing)
+  {
+    c->paused = 0;
+    set_events (c);
+  }
+}
+
+static void read_conn (conn_t *c)
+/*
+    Read what the client has sent and pass on complete lines
+*/
+{
+  int got;
+
+  while (!c->closing && c->in_len < IN_LEN - 1)
+  {
+    got = read (c->socket, c->in + c->in_len, IN_LEN - 1 - c->in_len);
+    if (got < 0 && (errno == EAGAIN || errno == EWOULDBLOCK))
+      break;
+    if (got <= 0)
+    {
+      c->closing = 1;
+      return;
+    }
+    c->in_len += got;
+    dispatch (c);
+  }
+  if (c->in_len == IN_LEN - 1 && !c->paused && !c->closing)
+  {
+    // Full while waiting for the workers: stop reading until they answer
+    c->paused = 1;
+    set_events (c);
+  }
+}
+
+static void collect_replies (void)
+/*
+    Send the replies the workers have finished and pass on the next
+    line of each connection they came from
+*/
+{
+  uint64_t count;
+  job_t *job;
+  conn_t *c;
+
+  read (wakefd, &count, sizeof (count));
+  while ((job = ring_pop (&done_q)) != NULL)
+  {
+    c = job->conn;
+    c->busy = 0;
+    if (!c->closed)
+    {
+      conn_reply (c, job->reply, job->reply_len);
+      if (job->quit)
+      {
+        printf ("Client is terminating.\n");
+        c->closing = 1;
+      }
+      dispatch (c);
+    }
+    job->next = free_jobs;
+    free_jobs = job;
+    if (c->closing || c->closed)
+      close_conn (c);
+  }
+}
+//==============================================================================
+// Connection functions: End
+//==============================================================================
+
+static void accept_clients (int server_socket)
+{
+  struct sockaddr_in client_addr;
+  socklen_t client_len;
+  struct epoll_event ev;
+  conn_t *c;
+  int s;
+
+  while (1)
+  {
+    client_len = sizeof (client_addr);
+    s = accept4 (server_socket, (struct sockaddr *) &client_addr, &client_len, SOCK_NONBLOCK);
+    if (s < 0)
+    {
+      if (errno == EMFILE || errno == ENFILE)
+      {
+        // Wait for a connection to close, or for the retry timeout
+        perror ("accept");
+        pause_accept (1);
+      }
+      else if (errno != EAGAIN && errno != EWOULDBLOCK && errno != EINTR)
+        perror ("accept");
+      return;
+    }
+    if ((c = calloc (1, sizeof (conn_t))) == NULL)
+    {
+      close (s);
+      continue;
+    }
+    c->socket = s;
+    ev.events = EPOLLIN;
+    ev.data.ptr = c;
+    if (epoll_ctl (epfd, EPOLL_CTL_ADD, s, &ev) != 0)
+    {
+      perror ("epoll_ctl");
+      close (s);
+      free (c);
+      continue;
+    }
+    nconns++;
+    printf ("Connection established to %s (%d clients)\n",
+            inet_ntoa (client_addr.sin_addr), nconns);
+  }
+}
+
+//==============================================================================
+// createServer funtion: Assignment 5
+//==============================================================================
+void *createServer(void *arg)
+{
+  int server_socket, one = 1;
+  struct sockaddr_in server_addr;
+  struct epoll_event ev, events[MAX_EVENTS];
+  conn_t *c;
+  int result, i, n;
+
+  // Create unnamed socket and give it a "name"
+  server_socket = socket (PF_INET, SOCK_STREAM | SOCK_NONBLOCK, 0);
+  setsockopt (server_socket, SOL_SOCKET, SO_REUSEADDR, &one, sizeof (one));
+  server_addr.sin_family = AF_INET;
+  result = inet_aton (SERVER, &server_addr.sin_addr);
+  if (result == 0)
+  {
+    printf ("inet_aton failed\n");
+    return NULL;
+  }
+  server_addr.sin_port = htons (PORT);
+
+  // Bind to the socket
+  result = bind (server_socket, (struct sockaddr *) &server_addr, sizeof (server_addr));
+  if (result != 0)
+  {
+    perror ("bind");
+    return NULL;
+  }
+
+  // Create a client queue
+  result = listen (server_socket, SOMAXCONN);
+  if (result != 0)
+  {
+    perror ("listen");
+    return NULL;
+  }
+
+  // The listening socket is registered with no data and the workers'
+  // eventfd with wake_marker; everything else is a connection
+  epfd = epoll_create1 (0);
+  listen_socket = server_socket;
+  ev.events = EPOLLIN;
+  ev.data.ptr = NULL;
+  if (epfd < 0 || epoll_ctl (epfd, EPOLL_CTL_ADD, server_socket, &ev) != 0)
+  {
+    perror ("epoll");
+    return NULL;
+  }
+  ev.data.ptr = &wake_marker;
+  if (epoll_ctl (epfd, EPOLL_CTL_ADD, wakefd, &ev) != 0)
+  {
+    perror ("epoll");
+    return NULL;
+  }
+  printf ("Network server running with %d workers\n", nworkers);
+
+  while (1)
+  {
+    n = epoll_wait (epfd, events, MAX_EVENTS, accept_paused ? ACCEPT_RETRY_MS : -1);
+    if (n < 0 && errno != EINTR)
+    {
+      perror ("epoll_wait");
+      break;
+    }
+    // The descriptors may be held outside this server, so try again
+    if (n == 0 && accept_paused)
+      pause_accept (0);
+    for (i = 0; i < n; i++)
+    {
+      if ((c = events[i].data.ptr) == NULL)
+      {
+        accept_clients (server_socket);
+        continue;
+      }
+      if (events[i].data.ptr == &wake_marker)
+      {
+        collect_replies ();
+        continue;
+      }
+      // Replies collected earlier in this batch may have closed c
+      if (c->closed)
+        continue;
+      if (events[i].events & (EPOLLERR | EPOLLHUP))
+        c->closing = 1;
+      if (!c->closing && (events[i].events & EPOLLIN))
+        read_conn (c);
+      if (!c->closing && (events[i].events & EPOLLOUT) && c->out_len)
+        flush_conn (c);
+      if (c->closing)
+        close_conn (c);
+    }
+    while ((c = dead_conns) != NULL)
+    {
+      dead_conns = c->dead;
+      free (c);
+    }
+  }
+  close (epfd);
+  close (server_socket);
+  return NULL;
+}
+//==============================================================================
+// createServer function: End
+//==============================================================================
+
+#define CHECK_ERROR if (error) { \
+        printf ("%s\n", strerror (error)); \
+        return 1; }
+
+/*
+    Creates the worker pool and the queues between them and
+    the server thread, then starts up the create server thread
+    Create the Posix objects
+*/
+int createThread ()
+{
+  int error, i;
+  // Queues and the jobs that travel on them
+  ring_init (&work_q);
+  ring_init (&done_q);
+  for (i = 0; i < QUEUE_LEN; i++)
+  {
+    jobs[i].next = free_jobs;
+    free_jobs = &jobs[i];
+  }
+  if (sem_init (&work_ready, 0, 0) != 0 || (wakefd = eventfd (0, EFD_NONBLOCK)) < 0)
+  {
+    perror ("worker queue");
+    return 1;
+  }
+
+  // One worker per core
+  nworkers = sysconf (_SC_NPROCESSORS_ONLN);
+  if (nworkers < 1)
+    nworkers = 1;
+  if (nworkers > MAX_WORKERS)
+    nworkers = MAX_WORKERS;
+  for (i = 0; i < nworkers; i++)
+  {
+    error = pthread_create (&workerT[i], NULL, worker, NULL);
+    CHECK_ERROR;
+  }
+
+  // Create server thread
+  error = pthread_create (&createServerT, NULL, createServer, NULL);
+  CHECK_ERROR;
+
+  return 0;
+}
+
+/*
+    Cancel and join the createServerT thread and the workers
+*/
+void terminateThread (void)
+{
+	void *thread_val;
+  int i;
+  // Terminate createServer thread
+  pthread_cancel (createServerT);
+  pthread_join (createServerT, &thread_val);
+  // Terminate the workers
+  for (i = 0; i < nworkers; i++)
+  {
+    pthread_cancel (workerT[i]);
+    pthread_join (workerT[i], &thread_val);
+  }
+}
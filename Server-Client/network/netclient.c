@@ -32,12 +32,42 @@
 #define LOCAL "127.0.0.1"
 #define REMOTE "192.168.15.50"
 #define BUFLEN 80
+// Room for the longest reply, a lookup listing its records
+#define REPLY_LEN 8192
+
+/*
+    Read a record lookup reply: the "SERVER> n of m" line, then n lines
+    of records.  A reply with no count, such as an error, is one line.
+    Returns the length read, or -1 if the connection closed first.
+*/
+static int read_lookup (int client_socket, char *reply, int size)
+{
+  int len = 0, got, lines = 0, want = -1;
+  char *p;
+
+  while (want < 0 || lines < want + 1)
+  {
+    if (len == size - 1)
+      break;
+    got = read (client_socket, reply + len, size - 1 - len);
+    if (got <= 0)
+      return -1;
+    for (p = reply + len; p < reply + len + got; p++)
+      if (*p == '\n')
+        lines++;
+    len += got;
+    reply[len] = '\0';
+    if (want < 0 && lines > 0 && sscanf (reply, "SERVER> %d of", &want) != 1)
+      want = 0;
+  }
+  return len;
+}
 
 int main (int argc, char *argv[])
 {
   int client_socket;
   struct sockaddr_in client_addr;
-  char ch, text[BUFLEN];
+  char ch, text[BUFLEN], reply[REPLY_LEN];
   char *server = LOCAL;
   int result, len;
 
@@ -72,9 +102,14 @@ int main (int argc, char *argv[])
     ch = text[0];
     printf("%s", text);
     write (client_socket, text, strlen (text));
-    len = read (client_socket, text, sizeof (text));
-    text[len] = 0;
-    puts (text);
+    if (strncmp (text, "id", 2) == 0 || strncmp (text, "prefix", 6) == 0)
+      len = read_lookup (client_socket, reply, sizeof (reply));
+    else
+      len = read (client_socket, reply, sizeof (reply) - 1);
+    if (len <= 0)
+      break;
+    reply[len] = 0;
+    puts (reply);
   }
   
   while (ch != 'q');
@@ -0,0 +1,129 @@
+/*
+ * params.c
+ *
+ * Seqlock for the thermostat parameters
+ *
+ * The setpoint, limit, deadband and latest sample are read on every
+ * control loop pass and by every monitor query, and changed rarely.
+ * Readers never block: they copy the parameters and check that the
+ * sequence number was even and unchanged around the copy, retrying in
+ * the rare case a writer got in between.  Writers are serialized by a
+ * mutex among themselves only, make the sequence odd, store, and make
+ * it even again, so a reader sees either all of a change or none of it.
+ *
+ * Nothing but loads and stores happens between the sequence updates;
+ * formatting and socket I/O are done by the callers on their copy.
+ *
+ * The latest sample is the exception: it doesn't have to agree with
+ * the other three, so the control loop publishes it with one atomic
+ * store and never touches the writers' mutex.
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.
+ * If not, see <https://www.gnu.org/licenses/>
+*/
+#include <pthread.h>
+#include <stdatomic.h>
+
+#include "params.h"
+
+static _Atomic unsigned int seq;
+static _Atomic int param[NUM_PARAMS];
+static pthread_mutex_t writeMutex = PTHREAD_MUTEX_INITIALIZER;
+
+void params_init (const params_t *initial)
+{
+  params_set (PARAM_SETPOINT, initial->setpoint);
+  params_set (PARAM_LIMIT, initial->limit);
+  params_set (PARAM_DEADBAND, initial->deadband);
+  params_set_value (initial->value);
+}
+
+void params_get (params_t *snap)
+/*
+    Consistent copy of all the parameters
+*/
+{
+  unsigned int start;
+
+  do
+  {
+    while ((start = atomic_load_explicit (&seq, memory_order_acquire)) & 1)
+      ;   // a writer is storing; it only takes a few stores
+    snap->setpoint = atomic_load_explicit (&param[PARAM_SETPOINT], memory_order_relaxed);
+    snap->limit = atomic_load_explicit (&param[PARAM_LIMIT], memory_order_relaxed);
+    snap->deadband = atomic_load_explicit (&param[PARAM_DEADBAND], memory_order_relaxed);
+    snap->value = atomic_load_explicit (&param[PARAM_VALUE], memory_order_relaxed);
+    atomic_thread_fence (memory_order_acquire);
+  }
+  while (atomic_load_explicit (&seq, memory_order_relaxed) != start);
+}
+
+int params_get_one (int id)
+/*
+    One parameter, which is a single atomic load and needs no retry
+*/
+{
+  return atomic_load_explicit (&param[id], memory_order_relaxed);
+}
+
+void params_set (int id, int v)
+{
+  params_set_many (&id, &v, 1);
+}
+
+void params_set_many (const int *ids, const int *values, int n)
+/*
+    Set n parameters as one change: a reader sees all of them or none
+*/
+{
+  unsigned int s;
+  int i;
+
+  pthread_mutex_lock (&writeMutex);
+  s = atomic_load_explicit (&seq, memory_order_relaxed);
+  atomic_store_explicit (&seq, s + 1, memory_order_relaxed);
+  atomic_thread_fence (memory_order_release);
+  for (i = 0; i < n; i++)
+    atomic_store_explicit (&param[ids[i]], values[i], memory_order_relaxed);
+  atomic_store_explicit (&seq, s + 2, memory_order_release);
+  pthread_mutex_unlock (&writeMutex);
+}
+
+void params_set_value (int v)
+/*
+    Publish the latest sample.  A single store outside the seqlock, so
+    the control loop never waits for a writer holding the mutex.
+*/
+{
+  atomic_store_explicit (&param[PARAM_VALUE], v, memory_order_release);
+}
+
+int param_id (char letter)
+/*
+    Id of the parameter a protocol letter names, or -1
+*/
+{
+  switch (letter)
+  {
+    case 's':
+      return PARAM_SETPOINT;
+    case 'l':
+      return PARAM_LIMIT;
+    case 'd':
+      return PARAM_DEADBAND;
+    case 't':
+      return PARAM_VALUE;
+  }
+  return -1;
+}
@@ -0,0 +1,47 @@
+/*
+ * params.h
+ *
+ * Thermostat parameters shared by the control loop and the network
+ * monitors, published as a seqlock snapshot (see params.c).
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.
+ * If not, see <https://www.gnu.org/licenses/>
+*/
+#ifndef PARAMS_H_
+#define PARAMS_H_
+
+typedef struct
+{
+  int setpoint;
+  int limit;
+  int deadband;
+  int value;      // latest temperature sample
+} params_t;
+
+// Parameter ids, in params_t order
+#define PARAM_SETPOINT 0
+#define PARAM_LIMIT    1
+#define PARAM_DEADBAND 2
+#define PARAM_VALUE    3
+#define NUM_PARAMS     4
+
+void params_init (const params_t *initial);
+void params_get (params_t *snap);
+int params_get_one (int id);
+void params_set (int id, int v);
+void params_set_many (const int *ids, const int *values, int n);
+void params_set_value (int v);
+int param_id (char letter);
+
+#endif /*PARAMS_H_*/
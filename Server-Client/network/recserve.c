@@ -0,0 +1,123 @@
+/*
+ * recserve.c
+ *
+ * Record lookup service for the thermostat servers.
+ *
+ * The datafile is read once, at startup and before any client thread
+ * runs, and indexed by ID and by name with build_lookup().  The indexes
+ * are never changed after that, so the monitor threads search them
+ * without taking a lock.
+ *
+ * A reply is a header line followed by the records, one per line:
+ *
+ * "SERVER> 2 of 2"
+ * "Brady_James 561"
+ * "Brady_Jane 561"
+ *
+ * Only the first MAX_HITS matches are listed; the header gives how
+ * many were listed and how many there are.
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.
+ * If not, see <https://www.gnu.org/licenses/>
+*/
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "record_sort.h"
+#include "recserve.h"
+
+// Room for the "SERVER> n of m" header line
+#define HEADER_LEN 32
+
+static lookup_t lookup;
+static int loaded = 0;
+
+int load_records (char *filename)
+/*
+    Load filename and build the lookup indexes.  Returns 0, or -1 if the
+    file couldn't be read or indexed.
+*/
+{
+  record_t *records;
+  int size;
+  double start = now_ms ();
+
+  if (map_file (filename, &size, &records) != 0)
+  {
+    printf ("Couldn't open record file %s\n", filename);
+    return -1;
+  }
+  if (build_lookup (&lookup, size, records) != 0)
+  {
+    printf ("Couldn't index record file %s\n", filename);
+    return_records (size, records);
+    return -1;
+  }
+  // The lookup has its own copies of the records; the names stay in
+  // the mapping
+  free (records);
+  loaded = 1;
+  printf ("%d records loaded from %s in %.1f ms\n", size, filename, now_ms () - start);
+  return 0;
+}
+
+int is_lookup (const char *cmd)
+{
+  return strcmp (cmd, "id") == 0 || strcmp (cmd, "prefix") == 0;
+}
+
+int lookup_reply (const char *cmd, const char *arg, char *reply, int len)
+/*
+    Answer the lookup cmd for arg into reply, which has room for len
+    bytes.  Returns the length of the reply.
+*/
+{
+  char header[HEADER_LEN];
+  int i, n, first = 0, line, used = HEADER_LEN, head;
+  unsigned int id;
+  record_t *hits;
+
+  if (!loaded)
+    return snprintf (reply, len, "SERVER> no records loaded\n");
+  if (arg == NULL)
+    return snprintf (reply, len, "SERVER> %s needs an argument\n", cmd);
+
+  if (strcmp (cmd, "id") == 0)
+  {
+    if (parse_ID (arg, &id) != 0)
+      return snprintf (reply, len, "SERVER> bad id\n");
+    n = lookup_ID (&lookup, id, &first);
+    hits = lookup.by_ID;
+  }
+  else
+  {
+    n = lookup_prefix (&lookup, arg, &first);
+    hits = lookup.by_name;
+  }
+
+  // The records go after room for the header, which needs their count
+  for (i = 0; i < n && i < MAX_HITS; i++)
+  {
+    line = snprintf (reply + used, len - used, "%s %u\n",
+                     hits[first + i].name, hits[first + i].ID);
+    if (line >= len - used)
+      break;
+    used += line;
+  }
+  head = snprintf (header, sizeof (header), "SERVER> %d of %d\n", i, n);
+  memmove (reply + head, reply + HEADER_LEN, used - HEADER_LEN);
+  memcpy (reply, header, head);
+  return head + used - HEADER_LEN;
+}
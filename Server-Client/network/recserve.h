@@ -0,0 +1,36 @@
+/*
+ * recserve.h
+ *
+ * Record lookup service for the thermostat servers.  A record_sort
+ * datafile is loaded once at startup into the lookup indexes of
+ * Record-Sort/query.c, and clients query it with:
+ *
+ * "id #"     : records with ID #
+ * "prefix P" : records whose name starts with P
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.
+ * If not, see <https://www.gnu.org/licenses/>
+*/
+#ifndef RECSERVE_H_
+#define RECSERVE_H_
+
+// Records listed in one reply, and room for them
+#define MAX_HITS 50
+#define REPLY_LEN 4096
+
+int load_records (char *filename);
+int is_lookup (const char *cmd);
+int lookup_reply (const char *cmd, const char *arg, char *reply, int len);
+
+#endif /*RECSERVE_H_*/
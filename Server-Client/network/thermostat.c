@@ -8,6 +8,11 @@
  * 
  * This is fork() and posix threads based multitasking implementation.
  *
+ * Usage: thermostat_s [wait [recordfile]]
+ *
+ * wait is the seconds between samples (2).  A record_sort datafile
+ * given as recordfile is served to the network clients by recserve.c.
+ *
  * Written by: Pratik yadav
  *     
  * This program is free software: you can redistribute it and/or modify
@@ -34,6 +39,8 @@
 #include "thermostat.h"
 #include "libmc-pcf8591.h"
 #include "libmc-gpio.h"
+#include "recserve.h"
+#include "params.h"
 
 /*
     Thermostat application definitions
@@ -57,8 +64,6 @@
 
 int running = 1;
 
-unsigned int setpoint, limit, deadband;
-
 u_int8_t alarm_action;   // variable to track alarm actions
 u_int8_t cooler_action;  // variable to track cooler actions
 
@@ -77,7 +82,11 @@ int main (int argc, char *argv[])
   unsigned int wait, sample = 0;
   alarm_action = NO_ACTION;
   cooler_action = NO_ACTION;
-  setpoint=65, limit=95, deadband=1, value=0;
+  value=0;
+  // setpoint, limit, deadband and the latest sample, shared with the
+  // monitor through params.c
+  params_t initial = {65, 95, 1, 0}, p;
+  params_init (&initial);
   // Share memory between parent and child process
   int shared_mem[2];
   pipe(shared_mem);
@@ -87,6 +96,9 @@ int main (int argc, char *argv[])
       sscanf (argv[1], "%d", &wait);
   else
       wait = 2;
+  // Record file for the lookup service, loaded before any client connects
+  if (argc > 2 && load_records (argv[2]) != 0)
+      exit (2);
 
   // Initialize LEDs
   if (init_leds(0) < 0)
@@ -202,17 +214,19 @@ int main (int argc, char *argv[])
         sample++;
         static u_int8_t state_cooler = NORMAL;
         int temperature_cooler = value;
-        //get exclusive access to parameters
-        pthread_mutex_lock (&paramMutex);
+        // Publish the sample and take a consistent copy of the parameters;
+        // this never waits for the monitor
+        params_set_value (value);
+        params_get (&p);
         // Parent wants to write shared_mem for the child process
         close(shared_mem[0]);
-        write(shared_mem[1], &limit, sizeof(limit));
+        write(shared_mem[1], &p.limit, sizeof(p.limit));
         switch(state_cooler)
         {
           case NORMAL:
             cooler_action = NO_ACTION;
             // Cooler action
-            if(temperature_cooler>(setpoint+deadband))
+            if(temperature_cooler>(p.setpoint+p.deadband))
             {
               cooler_action = COOLER_ON;
               state_cooler = HIGH;
@@ -221,7 +235,7 @@ int main (int argc, char *argv[])
 
           case HIGH:
             //Cooler action
-            if(temperature_cooler<(setpoint-deadband))
+            if(temperature_cooler<(p.setpoint-p.deadband))
             {
               cooler_action = COOLER_OFF;
               state_cooler = NORMAL;
@@ -230,7 +244,7 @@ int main (int argc, char *argv[])
 
           case LIMIT:
             // Cooler action
-            if(temperature_cooler<(setpoint-deadband))
+            if(temperature_cooler<(p.setpoint-p.deadband))
             {
               cooler_action = COOLER_OFF;
               state_cooler = NORMAL;
@@ -242,9 +256,6 @@ int main (int argc, char *argv[])
             break;
         }
         
-        // release the parameters
-        pthread_mutex_unlock (&paramMutex);
-        
         // cooler actions
         switch(cooler_action)
         {